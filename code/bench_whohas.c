@@ -0,0 +1,153 @@
+/*
+  Benchmark of WHOHAS handling as the number of owned chunks grows.
+
+  For each size of the have set, a full WHOHAS is serialized, half of its
+  hashes owned, and its hashes are looked up through a PacketView exactly as
+  receive_WHOHAS does.  A scan of the have list is timed next to it for
+  comparison: the set stays flat while the scan grows with the chunks.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+
+#include "chunk.h"
+#include "chunk_set.h"
+#include "list.h"
+#include "mytime.h"
+#include "packet.h"
+
+#define MAX_CHUNKS 65536
+#define SET_ROUNDS 20000 /* WHOHAS handled per measurement */
+#define SCAN_WORK (1 << 24) /* hash comparisons per list measurement */
+
+static uint8_t owned_hashes[MAX_CHUNKS][BIN_HASH_SIZE];
+
+static volatile unsigned sink; /* keeps the lookups from being optimized out */
+
+/* the hash of chunk i; hashes from i >= MAX_CHUNKS are never owned */
+static void bench_hash(unsigned i, uint8_t *bin_hash) {
+    shahash((uint8_t *) &i, sizeof(i), bin_hash);
+}
+
+/* the lookups of receive_WHOHAS in the have set, without the IHAVE reply */
+static unsigned lookup_set(void *have_set, PacketView *pack) {
+    int i, found = 0;
+
+    for (i = 0; i < packet_view_hash_num(pack); i++) {
+        if (chunk_set_find(have_set, packet_view_hash(pack, i)) != NULL) {
+            found++;
+        }
+    }
+
+    return found;
+}
+
+/* the same lookups by a scan of the have list */
+static unsigned lookup_list(void *have_list, PacketView *pack) {
+    List *have = have_list;
+    ListLink *link;
+    chunk *c;
+    int i, found = 0;
+
+    for (i = 0; i < packet_view_hash_num(pack); i++) {
+        list_for_each(link, have) {
+            c = list_entry(link, chunk, link);
+
+            if (compare_chunk_by_bin_hash(c, packet_view_hash(pack, i))) {
+                found++;
+                break;
+            }
+        }
+    }
+
+    return found;
+}
+
+/* the average time of one call of lookup over rounds calls, in ns */
+static double time_lookups(unsigned (*lookup)(void *, PacketView *),
+                           void *chunks, PacketView *pack, unsigned rounds) {
+    nstime_t start;
+    unsigned r;
+
+    start = mytime_update();
+
+    for (r = 0; r < rounds; r++) {
+        sink += lookup(chunks, pack);
+    }
+
+    return (double) (mytime_update() - start) / rounds;
+}
+
+int main() {
+    char hex_hash[HEX_HASH_SIZE + 1];
+    uint8_t *buf;
+    unsigned n = 0, size, i, scan_rounds;
+    double set_ns, list_ns;
+    ChunkSet set;
+    List have;
+    PacketView view;
+    Packet whohas;
+    chunk *c;
+
+    if (chunk_set_init(&set) < 0) {
+        return EXIT_FAILURE;
+    }
+    list_init(&have);
+
+    for (i = 0; i < MAX_CHUNKS; i++) {
+        bench_hash(i, owned_hashes[i]);
+    }
+
+    /* a full WHOHAS: even hashes owned by every size of the set, odd ones
+       owned by none */
+    whohas.type = WHOHAS;
+    whohas.header_len = STANDARD_HEADER_LEN;
+    whohas.hash_num = MAX_HASH_IN_PACKET;
+    whohas.packet_len = STANDARD_HEADER_LEN + HEADER_PAD_LEN +
+        MAX_HASH_IN_PACKET * BIN_HASH_SIZE;
+    whohas.seq_num = 0;
+    whohas.ack_num = 0;
+
+    for (i = 0; i < MAX_HASH_IN_PACKET; i++) {
+        if (i % 2 == 0) {
+            memcpy(whohas.hash_list[i], owned_hashes[i / 2], BIN_HASH_SIZE);
+        } else {
+            bench_hash(MAX_CHUNKS + i, whohas.hash_list[i]);
+        }
+    }
+
+    buf = serialize_packet(&whohas);
+
+    if (buf == NULL || packet_view_init(&view, buf, whohas.packet_len) < 0) {
+        return EXIT_FAILURE;
+    }
+
+    printf("%8s %14s %14s\n", "chunks", "set ns/WHOHAS", "list ns/WHOHAS");
+
+    for (size = 64; size <= MAX_CHUNKS; size *= 4) {
+        /* grow the have list and set to size chunks */
+        for (; n < size; n++) {
+            binary2hex(owned_hashes[n], BIN_HASH_SIZE, hex_hash);
+            if ((c = create_chunk(n, (uint8_t *) hex_hash)) == NULL ||
+                chunk_set_insert(&set, c) < 0) {
+                return EXIT_FAILURE;
+            }
+            list_push_back(&have, &(c->link));
+        }
+
+        /* both find the owned half of the hashes */
+        assert(lookup_set(&set, &view) == (MAX_HASH_IN_PACKET + 1) / 2);
+        assert(lookup_list(&have, &view) == (MAX_HASH_IN_PACKET + 1) / 2);
+
+        scan_rounds = SCAN_WORK / (size * MAX_HASH_IN_PACKET) + 1;
+
+        set_ns = time_lookups(lookup_set, &set, &view, SET_ROUNDS);
+        list_ns = time_lookups(lookup_list, &have, &view, scan_rounds);
+
+        printf("%8u %14.0f %14.0f\n", size, set_ns, list_ns);
+    }
+
+    free(buf);
+    return 0;
+}
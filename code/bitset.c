@@ -0,0 +1,77 @@
+/*
+  Word-packed bitset with a low-water mark
+*/
+
+#include <string.h>
+
+#include "bitset.h"
+
+#define WORD(i) ((i) / BITSET_WORD_BITS)
+#define BIT(i) ((i) % BITSET_WORD_BITS)
+
+/*
+  Scan for the first bit at or after from whose value is the complement of
+  invert: invert 0 finds set bits, invert ~0 finds clear bits.
+*/
+static unsigned scan(const Bitset *b, unsigned from, uint64_t invert) {
+    unsigned w = WORD(from);
+    uint64_t word;
+
+    if (from >= b->nbits) {
+        return b->nbits;
+    }
+
+    /* mask off the bits below from in its word */
+    word = (b->words[w] ^ invert) & (~0ULL << BIT(from));
+
+    while (word == 0) {
+        if (++w >= (b->nbits + BITSET_WORD_BITS - 1) / BITSET_WORD_BITS) {
+            return b->nbits;
+        }
+        word = b->words[w] ^ invert;
+    }
+
+    from = w * BITSET_WORD_BITS + __builtin_ctzll(word);
+
+    /* the clear padding past nbits reads as set when inverted */
+    return from < b->nbits ? from : b->nbits;
+}
+
+void bitset_init(Bitset *b, unsigned nbits) {
+    b->nbits = nbits < BITSET_MAX_BITS ? nbits : BITSET_MAX_BITS;
+    bitset_clear_all(b);
+}
+
+void bitset_clear_all(Bitset *b) {
+    memset(b->words, 0, sizeof(b->words));
+    b->count = 0;
+    b->low = 0;
+}
+
+int bitset_set(Bitset *b, unsigned i) {
+    uint64_t mask = 1ULL << BIT(i);
+
+    if (i >= b->nbits || (b->words[WORD(i)] & mask)) {
+        return 0;
+    }
+
+    b->words[WORD(i)] |= mask;
+    b->count++;
+
+    /* closing the gap at the low-water mark moves it past the run of set
+       bits that follows */
+    if (i == b->low) {
+        b->low = scan(b, i, ~0ULL);
+    }
+
+    return 1;
+}
+
+unsigned bitset_next_clear(const Bitset *b, unsigned from) {
+    /* everything below the low-water mark is set */
+    return scan(b, from > b->low ? from : b->low, ~0ULL);
+}
+
+unsigned bitset_next_set(const Bitset *b, unsigned from) {
+    return scan(b, from, 0);
+}
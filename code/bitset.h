@@ -0,0 +1,64 @@
+/*
+  A fixed capacity bitset packed into 64-bit words.  Alongside the words it
+  keeps the number of set bits and a low-water mark, the first clear bit,
+  below which every bit is set.  Setting bits in roughly ascending order,
+  as a receiver does with sequence numbers, moves the low-water mark forward
+  a word at a time, so reading it is O(1) and maintaining it is amortized
+  O(1) per bit.  Scans skip whole words and use count trailing zeros inside
+  a word.
+*/
+
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <inttypes.h>
+
+#define BITSET_WORD_BITS 64
+#define BITSET_MAX_BITS 1024
+#define BITSET_MAX_WORDS (BITSET_MAX_BITS / BITSET_WORD_BITS)
+
+typedef struct {
+    uint64_t words[BITSET_MAX_WORDS]; /* bits past nbits are always clear */
+    unsigned nbits; /* number of bits in the set */
+    unsigned count; /* number of set bits */
+    unsigned low; /* the first clear bit, nbits if every bit is set */
+} Bitset;
+
+/*
+  Initialize an empty bitset of nbits bits, at most BITSET_MAX_BITS.
+*/
+void bitset_init(Bitset *b, unsigned nbits);
+
+/*
+  Clear every bit.
+*/
+void bitset_clear_all(Bitset *b);
+
+/*
+  Set bit i.
+
+  Returns 1 if the bit was clear before, 0 otherwise.
+*/
+int bitset_set(Bitset *b, unsigned i);
+
+/*
+  Returns the first clear bit at or after from, nbits if there is none.
+*/
+unsigned bitset_next_clear(const Bitset *b, unsigned from);
+
+/*
+  Returns the first set bit at or after from, nbits if there is none.
+*/
+unsigned bitset_next_set(const Bitset *b, unsigned from);
+
+/* Returns 1 if bit i is set, 0 otherwise. */
+static inline int bitset_test(const Bitset *b, unsigned i) {
+    return (b->words[i / BITSET_WORD_BITS] >> (i % BITSET_WORD_BITS)) & 1;
+}
+
+/* Returns 1 if every bit is set, 0 otherwise. */
+static inline int bitset_full(const Bitset *b) {
+    return b->count == b->nbits;
+}
+
+#endif
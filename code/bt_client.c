@@ -5,44 +5,50 @@
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
+#include <unistd.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
 #include "bt_client.h"
+#include "bt_io.h"
+#include "chunk_store.h"
 #include "transfer.h"
+#include "transfer_table.h"
 #include "peer.h"
 #include "log.h"
 #include "sha.h"
+#include "spiffy.h"
+#include "slab.h"
+#include "packet_pool.h"
 
 #define MAX_GET_FOR_DENIED 1000
 
-static Node *transfers; /* a linked list of current data transfers (incoming) */
+static TransferTable transfers; /* current data transfers (incoming) */
 static unsigned get_chunk_data(void);
 static int validate_chunk(Transfer *transfer);
 static int chunk_bits_all_received(Transfer *transfer);
 static uint32_t data_find_largest_consec_seq(Transfer *transfer);
-static void data_store(Packet *pack, Transfer *transfer);
-static int data_already_stored(Packet *pack, Transfer *transfer);
+static uint16_t data_build_sack(Transfer *transfer, uint32_t ack_num,
+                                uint8_t *sack);
+static void data_store(PacketView *pack, Transfer *transfer);
+static void data_mark_stored(uint32_t seq_num, Transfer *transfer);
+static int data_already_stored(uint32_t seq_num, Transfer *transfer);
+static void data_received(Transfer *transfer, uint32_t seq_num,
+                          bt_config_t *config);
+static int data_fits_chunk(uint32_t seq_num, uint16_t data_len);
+static void handle_transfer_timeout(Timer *timer, void *arg);
+
+int client_init(void) {
+    return transfer_table_init(&transfers);
+}
 
 /**
- * Returns 1 if the peer exists in the linked list, 0 otherwise.
+ * Remove a transfer from the transfer table and free it.
  */
-static int peer_exist_in_list(Node **head, bt_peer_t* target_p) {
-    Node* p_node;
-    Node* next;
-    bt_peer_t* p;
-
-    /* returns 1 if the peer list contains target peer already */
-    for(p_node = *head; p_node != NULL; p_node = next) {
-        next = p_node->next;
-        p = p_node->data;
-        if (p->id == target_p->id) {
-            return 1;
-        }
-    }
-
-    return 0;
+static void remove_transfer(Transfer *transfer) {
+    transfer_table_remove(&transfers, transfer);
+    delete_transfer(transfer);
 }
 
 /**
@@ -53,25 +59,41 @@ static int init_data_transfer(bt_config_t *config) {
     return EXIT_FAILURE;
 }
 
+int write_chunk_to_output(chunk *c, unsigned id) {
+    if (write_chunk_data_file_by_id(user_output_fd, id, c->chunk_data) < 0) {
+        return -1;
+    }
+
+    LOG("Write chunk (%u) with hash (%s) of file.\n", id, chunk_hex_hash(c));
+    return 0;
+}
+
 /**
- * Contruct the output file with wanted chunks data.
+ * Write a downloaded chunk at every id it was wanted at, then map it back
+ * from the output file in place of its download buffer.
  */
-static void construct_data(void) {
-    FILE* pFile;
-    Node* node;
-    chunk* c;
+static void store_chunk_output(chunk *c) {
+    unsigned i;
 
-    pFile = fopen(user_output_filename, "w+b");
+    for (i = 0; i < c->output_count; i++) {
+        if (write_chunk_to_output(c, chunk_output_id(c, i)) < 0) {
+            return;
+        }
+    }
 
-    /* moves the wanted chunks data to output file */
-    for (node = wanted; node != NULL; node = node->next) {
-        c = node->data;
-        LOG("Write chunk (%d) with hash (%s) of file.\n",
-                   c->id, c->hex_hash);
-        fseek(pFile , c->id * BT_CHUNK_SIZE, SEEK_SET);
-        fwrite(c->chunk_data, sizeof(char), BT_CHUNK_SIZE, pFile);
+    /* the download buffer is no longer needed once the data is on disk; c->id
+       is the first id the chunk was wanted at */
+    if (c->data_type == CHUNK_DATA_HEAP) {
+        chunk_store_map_chunk(c, user_output_fd);
     }
-    fclose(pFile);
+}
+
+/**
+ * Finish the output file once every wanted chunk has been written to it.
+ */
+static void complete_output(void) {
+    close(user_output_fd);
+    user_output_fd = -1;
 
     /* tell the user the data transfer is completed */
     printf("GOT %s\n", user_get_chunk_file);
@@ -85,26 +107,29 @@ static void construct_data(void) {
  * Check if all chunks are received.
  */
 void check_all_received(void) {
-    Node *node, *next;
+    unsigned i;
 
     /* checks if there is anything chunks left in the missing chunks list */
-    if (count_node(&missing)) {
-        LOG("(%d) chunks are not received.\n",
-                    count_node(&missing));
+    if (missing.size) {
+        LOG("(%zu) chunks are not received.\n", missing.size);
         return;
     }
     else {
         /* all chunks have received */
-        construct_data();
+        complete_output();
 
-        /* clear wanted list */
-        for(node = wanted; node != NULL; node = next) {
-            next = node->next;
-            node_delete(&(wanted), node, NULL);
+        /* clear wanted list, and the output ids of its chunks */
+        for (i = 0; i < wanted.size; i++) {
+            chunk_clear_outputs(wanted.items[i]);
         }
 
-        assert(wanted == NULL);
+        vector_clear(&wanted);
         LOG("Cleared wanted list.\n");
+
+        slab_log_stats();
+        packet_log_counters();
+        LOG("packet pool: %u/%u buffers in use, peak %u\n",
+            packet_pool_in_use(), PACKET_POOL_SIZE, packet_pool_peak());
     }
 }
 
@@ -112,8 +137,7 @@ void check_all_received(void) {
  * Begin gather data from other peers by sending GET packages
  */
 static unsigned get_chunk_data(void) {
-    Node* node;
-    Node* transfer_node;
+    ListLink *link;
     chunk* c;
     bt_peer_t* peer;
     Transfer *transfer;
@@ -121,32 +145,47 @@ static unsigned get_chunk_data(void) {
 
     /* loops through each missing chunk to see if they have a available peer to
      * send GET packet */
-    for (node = missing; node != NULL; node = node->next) {
-        c = node->data;
+    list_for_each(link, &missing) {
+        c = list_entry(link, chunk, link);
 
         /* make sures a transfer has not created with this chunk yet */
-        transfer_node = node_find(transfers, compare_transfer_by_chunk_hash,
-                                  c->bin_hash);
+        if (transfer_table_find_by_chunk(&transfers, c->bin_hash) != NULL) {
+            continue;
+        }
 
         peer = find_first_available_peer(c);
 
         /* make sure the chunk has a available peer */
-        if (peer != NULL && transfer_node == NULL) {
+        if (peer != NULL) {
+            /* the chunk needs a buffer to be downloaded into */
+            if (c->chunk_data == NULL &&
+                chunk_alloc_data(c) != EXIT_SUCCESS) {
+                continue;
+            }
+
             transfer = create_transfer(peer, c);
 
-            if (transfer != NULL) {
-                node_insert(&transfers, transfer);
+            if (transfer != NULL &&
+                transfer_table_insert(&transfers, transfer) < 0) {
+                delete_transfer(transfer);
+            }
+            else if (transfer != NULL) {
+                transfer_set_timeout(transfer, handle_transfer_timeout,
+                                     transfer);
                 send_GET(peer, c->bin_hash, 1);
 
-                LOG("New transfer for chunk (%u) to peer (%u).\n", c->id,
+                /* the first DATA times the GET; resent GETs are not timed */
+                rtt_start(&(transfer->cctrl.rtt), 1);
+
+                LOG_INFO("New transfer for chunk (%u) to peer (%u).\n", c->id,
                     peer->id);
 
                 count++;
             }
         }
 
-        else if (peer == NULL && transfer_node == NULL) {
-            LOG("No available peer for chunk (%d).\n" , c->id);
+        else {
+            LOG_TRACE("No available peer for chunk (%d).\n" , c->id);
         }
     }
 
@@ -157,82 +196,77 @@ static unsigned get_chunk_data(void) {
  * Remove the dead peer from each missing chunks' peers list, and remove the
  * dead transfer node.
  */
-static void handle_transfer_dead(Node *transfer_node, bt_config_t *config) {
-    Node *node;
-    Node *p_node, *next;
-    bt_peer_t *p;
-    bt_peer_t *peer;
+static void handle_transfer_dead(Transfer *transfer) {
+    ListLink *link;
+    bt_peer_t *peer = transfer->peer;
     chunk *missing_c;
-    Transfer *transfer;
-
-    transfer = transfer_node->data;
-    peer = transfer->peer;
+    int i;
 
-    LOG("Transfer with peer (%d) is dead.\n", peer->id);
+    LOG_INFO("Transfer with peer (%d) is dead.\n", peer->id);
 
     /* remove the dead peer from each peers list in missing chunks */
-    for(node = missing; node != NULL; node = node->next) {
-        missing_c = node->data;
+    list_for_each(link, &missing) {
+        missing_c = list_entry(link, chunk, link);
 
-        /* check matching peer id of each peer in missing chunks list */
-        for(p_node = missing_c->peer; p_node != NULL; p_node = next) {
-            next = p_node->next;
-            p = p_node->data;
-
-            if (p->id == peer->id) {
-                node_delete(&(missing_c->peer), p_node, NULL);
-            }
+        if ((i = vector_index_of(&(missing_c->peers), peer)) >= 0) {
+            vector_swap_remove(&(missing_c->peers), i);
         }
     }
 
-    /* remove the transfer node from the transfer list */
-    node_delete(&(transfers), transfer_node, delete_transfer);
+    /* remove the transfer from the transfer table */
+    remove_transfer(transfer);
 }
 
 /*
-  Handles when the select call timeout:
-  1) loop through outstanding list and handle any time'd out GET requests
-  2) loop through transfers and handle any time'd out Transfers
+  Handles the timeout of the incoming transfer arg: an unanswered GET is
+  repeated, and the peer is given up on once it has timed out MAX_TO_COUNTS
+  times in a row.
 */
-void handle_client_timeout(bt_config_t *config) {
-    Node *node, *next;
-    Transfer *transfer;
-    chunk *c;
-    uint32_t ack_num;
+static void handle_transfer_timeout(Timer *timer, void *arg) {
+    Transfer *transfer = arg;
+    chunk *c = transfer->c;
 
-    if (!count_node(&missing)) {
+    timer = timer; /* quiet GCC compilation */
+
+    LOG_INFO("Transfer to peer (%u) for chunk (%u) has timedout.\n",
+        transfer->peer->id, c->id);
+
+    if (++(transfer->cctrl.timeout_count) >= MAX_TO_COUNTS) {
+        handle_transfer_dead(transfer);
+
+        /* the chunk may be available from another peer */
+        get_chunk_data();
         return;
     }
 
-    /* check the transfers and handle any timeout transfers */
-    for (node = transfers; node != NULL; node = next) {
-        next = node->next;
-        transfer = node->data;
-        c = transfer->c;
+    rtt_backoff(&(transfer->cctrl.rtt));
 
-        if (transfer_has_timeout(transfer)) {
-            if (++(transfer->cctrl.timeout_count) >= MAX_TO_COUNTS) {
-                handle_transfer_dead(node, config);
-            }
-            else {
-                if (transfer->c->bits_count  == 0) {
-                    /* should resend GET if timeout happens for first DATA */
-                    send_GET(transfer->peer, c->bin_hash, 1);
-                }
-                else {
-                    /* should resend ACK if timeout happens for next DATA */
-                    ack_num = data_find_largest_consec_seq(transfer);
-                    send_ACK(transfer->peer, ack_num);
-                }
-            }
-        }
+    if (c->received->count == 0) {
+        /* should resend GET if timeout happens for first DATA */
+        send_GET(transfer->peer, c->bin_hash, 1);
+    }
+    else {
+        /* the sender retransmits lost DATA on its own timeout, so just
+           keep waiting for it */
+        transfer_touch(transfer);
+    }
+}
+
+/*
+  Called periodically: start transfers for chunks that have an available
+  peer, and ask around again for chunks that have none.  Transfers time out
+  on their own timers.
+*/
+void handle_client_timeout(bt_config_t *config) {
+    if (!missing.size) {
+        return;
     }
 
     /* check if any new data transfer can be initiated */
     init_data_transfer(config);
 
     /* flood the network with WHOHAS if there is unclaimed chunk in missing */
-    if (node_length(transfers) < node_length(missing)) {
+    if (transfers.count < missing.size) {
         send_WHOHAS(config);
     }
 }
@@ -242,13 +276,10 @@ void handle_client_timeout(bt_config_t *config) {
 */
 void send_GET(bt_peer_t *peer, uint8_t *bin_hash, uint32_t count) {
     Packet pack;
-    Node *transfer_node;
-    Transfer *transfer;
+    Transfer *transfer = transfer_table_find_by_peer(&transfers, peer);
 
-    transfer_node = node_find(transfers, compare_transfer_by_peer_id, peer);
-
-    if (transfer_node == NULL) {
-        LOG("Failed to find match in transfers.");
+    if (transfer == NULL) {
+        LOG_ERROR("Failed to find match in transfers.");
         return;
     }
 
@@ -262,10 +293,8 @@ void send_GET(bt_peer_t *peer, uint8_t *bin_hash, uint32_t count) {
     pack.hash_num = (uint8_t)1;
     memcpy(pack.hash_list[0], bin_hash, BIN_HASH_SIZE);
 
-    transfer = transfer_node->data;
-
     /* measure the time between this GET and first DATA */
-    millitime(&(transfer->timestamp));
+    transfer_touch(transfer);
 
     send_packet_to_peer(sock, &pack, peer);
 }
@@ -275,15 +304,15 @@ void send_GET(bt_peer_t *peer, uint8_t *bin_hash, uint32_t count) {
  *
  */
 void send_WHOHAS(bt_config_t *config) {
-    Node* n;
+    ListLink *link;
     chunk* c;
     Packet* pack = (Packet*) calloc(1, sizeof(Packet));
     /* counts the number of hash appended to list so far */
     int count = 0;
 
     /* creates a list of hashes */
-    for (n = missing; n != NULL; n = n->next) {
-        c = n->data;
+    list_for_each(link, &missing) {
+        c = list_entry(link, chunk, link);
         /* generate a WHOHAS packet */
         memcpy(pack->hash_list[count], c->bin_hash, BIN_HASH_SIZE);
         count++;
@@ -291,7 +320,8 @@ void send_WHOHAS(bt_config_t *config) {
         /* prepare and send the hash list in a WHOHAS packet whenever */
         /* 74 hashes are appended to the list or that there is no more */
         /* chunk in the chunks linked list */
-        if ((count == MAX_HASH_IN_PACKET) || (n->next == NULL)) {
+        if ((count == MAX_HASH_IN_PACKET) ||
+            (list_next(&missing, link) == NULL)) {
             /* fill in the WHOHAS packet */
             pack->type = WHOHAS;
             pack->header_len = STANDARD_HEADER_LEN;
@@ -318,111 +348,97 @@ void send_WHOHAS(bt_config_t *config) {
         }
     }
 
+    free(pack);
     LOG("all WHOHAS packets sent\n");
     return;
 }
 
 /*
-  Send a ACK packet to the peer with given acknowledgement number.
+  Send a ACK packet to the peer with given acknowledgement number, and the
+  DATA received past it as a SACK bitmap.
 */
 void send_ACK(bt_peer_t *peer, unsigned ack_num) {
-    Packet packet;
-    Node *transfer_node;
+    uint8_t sack[SACK_MAX_LEN];
+    uint16_t sack_len;
     Transfer *transfer;
 
-    packet.type = ACK;
-    packet.header_len = STANDARD_HEADER_LEN;
-    packet.packet_len = packet.header_len;
-    packet.seq_num = 0;
-    packet.ack_num = ack_num;
+    transfer = transfer_table_find_by_peer(&transfers, peer);
 
-    transfer_node = node_find(transfers, compare_transfer_by_peer_id, peer);
-
-    if (transfer_node == NULL) {
-        LOG("Failed to find match in transfers.");
+    if (transfer == NULL) {
+        LOG_ERROR("Failed to find match in transfers.");
         return;
     }
 
-    transfer = transfer_node->data;
+    transfer->pending = 0;
 
     /* measure the time between this ACK and next DATA */
-    millitime(&(transfer->timestamp));
+    transfer_touch(transfer);
 
-    send_packet_to_peer(sock, &packet, peer);
-    LOG("Sent ACK (%u) to peer (%u).\n", ack_num, peer->id);
+    sack_len = data_build_sack(transfer, ack_num, sack);
+    send_ack_to_peer(sock, peer, ack_num, sack, sack_len);
+    LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE, "Sent ACK (%u) to peer (%u).\n",
+                      ack_num, peer->id);
 }
 
-/**
- * Process the DENIED packets recieved and remove the failed transfer node.
- */
-void receive_DENIED(Packet* pack, bt_config_t *config,
-                    struct sockaddr_in *p_addr) {
-    Node *transfer_node;
-    bt_peer_t *peer;
-
-    LOG("received DENIED from address (%s) port (%d)\n",
-               inet_ntoa(p_addr->sin_addr), ntohs(p_addr->sin_port));
+/*
+  Send the cumulative ACKs owed by the transfers that received in order DATA
+  during the last receive batch.
+*/
+void send_pending_ACKs(void) {
+    Transfer *transfer;
+    unsigned i;
 
-    /* find the peer structure from peers by a given peer address */
-    peer = find_peer(config, p_addr);
+    for (i = 0; i < transfers.count; i++) {
+        transfer = transfers.items[i];
 
-    if (peer == NULL) {
-        LOG("Failed to find a matching peer address in peers.");
-        return;
+        if (transfer->pending) {
+            send_ACK(transfer->peer, data_find_largest_consec_seq(transfer));
+        }
     }
+}
+
+/**
+ * Process the DENIED packets recieved and remove the failed transfer node.
+ */
+void receive_DENIED(PacketView *pack, bt_peer_t *peer) {
+    Transfer *transfer;
 
     LOG("DENIED from peer id (%d)\n", peer->id);
 
-    transfer_node = node_find(transfers, compare_transfer_by_peer_id, peer);
+    transfer = transfer_table_find_by_peer(&transfers, peer);
 
-    if (transfer_node == NULL) {
-        LOG("Failed to find match in transfers.");
+    if (transfer == NULL) {
+        LOG_ERROR("Failed to find match in transfers.");
         return;
     }
 
-    node_delete(&(transfers), transfer_node, delete_transfer);
+    remove_transfer(transfer);
 }
 
 /**
  * Process the IHAVE packets recieved, insert the peer to the missing chunk as
  * one of the peers that owns it.
  */
-void receive_IHAVE(Packet* pack, bt_config_t *config,
-                   struct sockaddr_in *p_addr) {
+void receive_IHAVE(PacketView *pack, bt_peer_t *peer, bt_config_t *config) {
     int i;
-    uint8_t* bin_hash;
     chunk* c;
-    Node* node;
-    bt_peer_t* peer;
-
-    /* find the peer structure from peers by a given peer address */
-    peer = find_peer(config, p_addr);
-
-    if (peer == NULL) {
-        LOG("Failed to find a matching peer address in peers.");
-        return;
-    }
 
     LOG("Received IHAVE from peer (%u).\n", peer->id);
-    LOG("Peer (%d) has (%d) hashes\n", peer->id, pack->hash_num);
+    LOG("Peer (%d) has (%d) hashes\n", peer->id, packet_view_hash_num(pack));
 
     /* insert the peer structure into missing chunks, so that in the */
     /* end, each chunk will have a linked list of peers that owns that */
     /* chunk */
-    for (i = 0; i < pack->hash_num; i++) {
-        bin_hash = pack->hash_list[i];
-        for (node = missing; node != NULL; node = node->next) {
-            c = node->data;
-            /* check if the missing chunk hash matches the hash from */
-            /* the IHAVE packet, and insert the peer to the chunk */
-            if (compare_bin_hash(c->bin_hash, bin_hash) == 1) {
-                /* add the peer to peer list if not added before */
-                if (peer_exist_in_list(&(c->peer), peer) == 0) {
-                    node_insert(&(c->peer), peer);
-                    LOG("Insert peer (%d) as available peer for chunk (%d).\n",
-                        peer->id, c->id);
-                }
-            }
+    for (i = 0; i < packet_view_hash_num(pack); i++) {
+        /* look up the missing chunk with the hash from the IHAVE packet, */
+        /* and insert the peer to the chunk */
+        c = chunk_set_find(&missing_set, packet_view_hash(pack, i));
+
+        /* add the peer to peer list if not added before */
+        if (c != NULL && vector_index_of(&(c->peers), peer) < 0 &&
+            vector_push(&(c->peers), peer) == 0) {
+            LOG("Insert peer (%d) as available peer for chunk (%d).\n",
+                peer->id, c->id);
         }
     }
 
@@ -439,27 +455,131 @@ void receive_IHAVE(Packet* pack, bt_config_t *config,
   Read the data in the packet, make sure that its hash value is correct,
   and then store the data inside the request chunk
 */
-void receive_DATA(Packet *pack, bt_peer_t *peer, bt_config_t *config) {
-    uint32_t ack_num;
-    Node *transfer_node;
+void receive_DATA(PacketView *pack, bt_peer_t *peer, bt_config_t *config) {
+    uint32_t seq_num = packet_view_seq_num(pack);
     Transfer *transfer;
 
-    transfer_node = node_find(transfers, compare_transfer_by_peer_id, peer);
-
-    if (transfer_node == NULL) {
-        LOG("Invalid tranfser node - NULL.\n");
+    if (!data_fits_chunk(seq_num, packet_view_data_len(pack))) {
+        LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE,
+                          "Invalid DATA (%u) from peer (%u).\n",
+                          seq_num, peer->id);
         return;
     }
 
-    transfer = transfer_node->data;
+    transfer = transfer_table_find_by_peer(&transfers, peer);
+
+    if (transfer == NULL) {
+        LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE, "Invalid tranfser node - NULL.\n");
+        return;
+    }
 
     /* records this data packet is stored if it haven't been stored yet*/
-    if (!data_already_stored(pack, transfer)) {
+    if (!data_already_stored(seq_num, transfer)) {
         data_store(pack, transfer);
     }
 
+    data_received(transfer, seq_num, config);
+}
+
+/*
+  Receive the next datagram on the socket straight into its chunk if it is a
+  new DATA packet of a transfer in progress.  The header is peeked first, and
+  the payload is then received with an iovec aimed at its slot in the chunk
+  data, so the kernel writes it to its final location.
+
+  Returns 1 if a datagram was consumed, 0 if the next datagram must go
+  through the regular receive path, and -1 if there is nothing to receive.
+*/
+int receive_DATA_direct(int sock, bt_config_t *config) {
+    uint8_t header[STANDARD_HEADER_LEN];
+    struct sockaddr_in from;
+    struct iovec iov[2];
+    struct msghdr msg;
+    Transfer *transfer;
+    bt_peer_t *peer;
+    uint32_t seq_num;
+    uint16_t data_len;
+    ssize_t n;
+
+    if (transfers.count == 0) {
+        return 0;
+    }
+
+    iov[0].iov_base = header;
+    iov[0].iov_len = STANDARD_HEADER_LEN;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &from;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 1;
+
+    /* peek at the header to find out where the payload belongs */
+    if ((n = spiffy_recvmsg(sock, &msg, MSG_PEEK | MSG_DONTWAIT)) < 0) {
+        return -1;
+    }
+
+    if (n < STANDARD_HEADER_LEN ||
+        packet_peek_data_header(header, &seq_num, &data_len) < 0 ||
+        !data_fits_chunk(seq_num, data_len) ||
+        (peer = find_peer(config, &from)) == NULL) {
+        return 0;
+    }
+
+    transfer = transfer_table_find_by_peer(&transfers, peer);
+
+    /* duplicates take the regular path, which ACKs them */
+    if (transfer == NULL || data_already_stored(seq_num, transfer)) {
+        return 0;
+    }
+
+    /* the payload lands in its slot of the chunk data */
+    iov[1].iov_base = transfer->c->chunk_data + (seq_num - 1) * DATA_SIZE;
+    iov[1].iov_len = data_len;
+    msg.msg_namelen = sizeof(from);
+    msg.msg_iovlen = 2;
+
+    n = spiffy_recvmsg(sock, &msg, MSG_DONTWAIT);
+
+    if (n != STANDARD_HEADER_LEN + data_len) {
+        LOG("Short DATA (%u) from peer (%u).\n", seq_num, peer->id);
+        return 1;
+    }
+
+    packet_count(&(packet_rx[DATA]), n);
+
+    /* initialize the peer timer */
+    peer->timer = millitime(NULL);
+    peer->timeout_count = 0;
+
+    data_mark_stored(seq_num, transfer);
+    data_received(transfer, seq_num, config);
+    return 1;
+}
+
+/*
+  Acknowledge a DATA packet that has been stored, and validate the chunk once
+  all of its data has arrived.
+*/
+static void data_received(Transfer *transfer, uint32_t seq_num,
+                          bt_config_t *config) {
+    bt_peer_t *peer = transfer->peer;
+    uint32_t ack_num;
+
+    /* DATA answers the GET and shows the sender is still alive */
+    rtt_ack(&(transfer->cctrl.rtt), seq_num);
+    transfer->cctrl.timeout_count = 0;
+
     ack_num = data_find_largest_consec_seq(transfer);
-    send_ACK(peer, ack_num);
+
+    if (ack_num == seq_num && !chunk_bits_all_received(transfer)) {
+        /* in order data is covered by one cumulative ACK per receive batch */
+        transfer->pending = 1;
+    } else {
+        /* out of order data is ACKed at once so that duplicate ACKs reach
+           the sender in time for fast retransmit */
+        send_ACK(peer, ack_num);
+    }
 
     if (chunk_bits_all_received(transfer)) {
         if (validate_chunk(transfer)) {
@@ -470,7 +590,7 @@ void receive_DATA(Packet *pack, bt_peer_t *peer, bt_config_t *config) {
            if data is valid, start new transfer
            else, need a new transfer to get the data anyway
         */
-        node_delete(&transfers, transfer_node, delete_transfer);
+        remove_transfer(transfer);
         init_data_transfer(config);
     }
 }
@@ -481,40 +601,81 @@ void receive_DATA(Packet *pack, bt_peer_t *peer, bt_config_t *config) {
 
   Returns 1 if the packet has already been received and stored, 0 otherwise.
 */
-static int data_already_stored(Packet *pack, Transfer *transfer) {
-    return transfer->c->bits[pack->seq_num - 1];
+static int data_already_stored(uint32_t seq_num, Transfer *transfer) {
+    return bitset_test(transfer->c->received, seq_num - 1);
+}
+
+/*
+  Return 1 if a payload of data_len bytes with the given sequence number fits
+  inside a chunk, 0 otherwise.
+*/
+static int data_fits_chunk(uint32_t seq_num, uint16_t data_len) {
+    return seq_num >= 1 && seq_num <= MAX_SEQ_NUM &&
+        (seq_num - 1) * DATA_SIZE + data_len <= BT_CHUNK_SIZE;
 }
 
 /*
   Store the chunk in the packet into the transfer's chunk storage
 */
-static void data_store(Packet *pack, Transfer *transfer) {
+static void data_store(PacketView *pack, Transfer *transfer) {
     chunk *c = transfer->c;
-    uint8_t *data = pack->data;
+    uint32_t seq_num = packet_view_seq_num(pack);
+
+    /* the payload is copied once, straight out of the receive buffer */
+    memcpy(c->chunk_data + ((seq_num - 1) * DATA_SIZE),
+           packet_view_data(pack), packet_view_data_len(pack));
 
-    memcpy(c->chunk_data + ((pack->seq_num - 1) * DATA_SIZE), data,
-           pack->packet_len - pack->header_len);
+    data_mark_stored(seq_num, transfer);
+}
 
-    transfer->c->bits[pack->seq_num - 1] = (char) 1;
-    transfer->c->bits_count++;
+/*
+  Record that the data of the given sequence number is in the transfer's
+  chunk storage
+*/
+static void data_mark_stored(uint32_t seq_num, Transfer *transfer) {
+    bitset_set(transfer->c->received, seq_num - 1);
 
-    LOG("Stored data (%u) for chunk (%u).\n", pack->seq_num, c->id);
+    LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE, "Stored data (%u) for chunk (%u).\n",
+                      seq_num, transfer->c->id);
 }
 
 /*
-  Loop through the transfer's chunk storage and return the
-  sequence number presenting the last of a consecutive chunk.
+  Return the sequence number presenting the last of a consecutive chunk,
+  which is the low-water mark of the received bits.
 
-  uint32_t should be [1, CHUNK_BITS_COUNT]
+  uint32_t should be [0, MAX_SEQ_NUM]
 */
 static uint32_t data_find_largest_consec_seq(Transfer *transfer) {
-    uint32_t i = 0;
+    return transfer->c->received->low;
+}
 
-    while(i < MAX_SEQ_NUM && transfer->c->bits[i]) {
-        i++;
+/*
+  Fill sack with the bitmap of the DATA received past ack_num: bit i is set
+  if the packet ack_num + 1 + i has been received.
+
+  Returns the bytes of bitmap up to the last one with a bit set, 0 if
+  everything received is covered by ack_num.
+*/
+static uint16_t data_build_sack(Transfer *transfer, uint32_t ack_num,
+                                uint8_t *sack) {
+    Bitset *received = transfer->c->received;
+    unsigned i, end = ack_num + SACK_MAX_LEN * 8;
+    uint16_t len = 0;
+
+    if (received->count == ack_num) {
+        return 0;
+    }
+
+    memset(sack, 0, SACK_MAX_LEN);
+
+    /* bit i of the bitmap is bit ack_num + i of the received bits */
+    for (i = bitset_next_set(received, ack_num); i < received->nbits &&
+         i < end; i = bitset_next_set(received, i + 1)) {
+        sack[(i - ack_num) / 8] |= 1 << ((i - ack_num) % 8);
+        len = (i - ack_num) / 8 + 1;
     }
 
-    return i;
+    return len;
 }
 
 /*
@@ -523,7 +684,7 @@ static uint32_t data_find_largest_consec_seq(Transfer *transfer) {
   return 1 if all have received, 0 otherwise
  */
 static int chunk_bits_all_received(Transfer *transfer) {
-    return transfer->c->bits_count == MAX_SEQ_NUM;
+    return bitset_full(transfer->c->received);
 }
 
 /*
@@ -539,7 +700,6 @@ static int chunk_bits_all_received(Transfer *transfer) {
 static int validate_chunk(Transfer *transfer) {
     uint8_t hash[SHA1_HASH_SIZE];
     chunk *c = transfer->c;
-    Node *missing_node;
     int result;
 
     shahash(c->chunk_data, BT_CHUNK_SIZE, hash);
@@ -547,24 +707,24 @@ static int validate_chunk(Transfer *transfer) {
     if ((result = compare_bin_hash(hash, c->bin_hash))) {
         LOG("Valid chunk data.\n");
 
-        missing_node = node_find(missing, compare_chunk_by_bin_wrapper,
-                                 c->bin_hash);
-
-        if (missing_node == NULL) {
-            LOG("Failed to find missing node to store data.\n");
+        if (chunk_set_remove(&missing_set, c->bin_hash) == NULL) {
+            LOG_ERROR("Failed to find missing node to store data.\n");
         } else {
-            node_delete(&(missing), missing_node, NULL);
-            node_insert(&(have), c);
+            list_remove(&missing, &(c->link));
+            list_push_back(&have, &(c->link));
+            chunk_set_insert(&have_set, c);
+
+            LOG_INFO("Now have chunk (%d).\n", c->id);
 
-            LOG("Now have chunk (%d).\n", c->id);
+            /* stream the chunk to disk as soon as it is verified */
+            store_chunk_output(c);
         }
     }
 
     else {
-        LOG("Invalid chunk data.\n");
+        LOG_INFO("Invalid chunk data.\n");
         memset(c->chunk_data, 0, BT_CHUNK_SIZE);
-        memset(c->bits, 0, sizeof(c->bits) * sizeof(c->bits[0]));
-        c->bits_count = 0;
+        bitset_clear_all(c->received);
     }
 
     return result;
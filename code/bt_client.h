@@ -3,20 +3,35 @@
 
 #include "packet.h"
 #include "bt_parse.h"
+#include "chunk.h"
+
+/*
+  Set up the client side state.
+
+  Returns 0 if successful, -1 otherwise.
+*/
+int client_init(void);
 
 void handle_client_timeout(bt_config_t *config);
 void check_all_received(void);
 
+/*
+  Write the data of a verified chunk at id in the output file.
+
+  Returns 0 if successful, -1 otherwise.
+*/
+int write_chunk_to_output(chunk *c, unsigned id);
+
 /* Sending functions */
 void send_WHOHAS(bt_config_t *config);
 void send_GET(bt_peer_t *peer, uint8_t *bin_hash, uint32_t count);
 void send_ACK(bt_peer_t *peer, unsigned ack_num);
+void send_pending_ACKs(void);
 
 /* Receiving functions */
-void receive_DATA(Packet *pack, bt_peer_t *peer, bt_config_t *config);
-void receive_DENIED(Packet* pack, bt_config_t *config,
-                    struct sockaddr_in *p_addr);
-void receive_IHAVE(Packet* pack, bt_config_t *config,
-                   struct sockaddr_in *p_addr);
+int receive_DATA_direct(int sock, bt_config_t *config);
+void receive_DATA(PacketView *pack, bt_peer_t *peer, bt_config_t *config);
+void receive_DENIED(PacketView *pack, bt_peer_t *peer);
+void receive_IHAVE(PacketView *pack, bt_peer_t *peer, bt_config_t *config);
 
 #endif
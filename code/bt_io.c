@@ -3,6 +3,7 @@
 #include <inttypes.h>
 #include <assert.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "chunk.h"
 #include "bt_io.h"
@@ -24,7 +25,7 @@ size_t read_chunk_data_file_by_id(char *filename, unsigned id, uint8_t *buf) {
 
     file = fopen(filename, "rb");
     if (file == NULL) {
-        LOG("Failed to open chunk data file"
+        LOG_ERROR("Failed to open chunk data file"
                    "%s\n", filename);
         return -1;
     }
@@ -45,7 +46,6 @@ size_t read_chunk_data_file_by_id(char *filename, unsigned id, uint8_t *buf) {
             return bytes_read;
         } else {
             LOG("File read error.");
-            free(buf);
             fclose(file);
             return -1;
         }
@@ -55,10 +55,31 @@ size_t read_chunk_data_file_by_id(char *filename, unsigned id, uint8_t *buf) {
     return bytes_read;
 }
 
-Node *parse_chunkfile(Node **list, char *chunkfile) {
+ssize_t write_chunk_data_file_by_id(int fd, unsigned id, uint8_t *buf) {
+    off_t offset = (off_t) id * BT_CHUNK_SIZE;
+    size_t written = 0;
+    ssize_t ret;
+
+    /* pwrite may write less than asked for, keep going until done */
+    while (written < BT_CHUNK_SIZE) {
+        ret = pwrite(fd, buf + written, BT_CHUNK_SIZE - written,
+                     offset + written);
+
+        if (ret <= 0) {
+            LOG_ERROR("Failed to write chunk (%u).\n", id);
+            return -1;
+        }
+
+        written += ret;
+    }
+
+    return written;
+}
+
+int parse_chunkfile(List *list, char *chunkfile) {
     FILE *f;
-    int id;
-    char line[FILE_LEN], hash[HEX_HASH_SIZE];
+    int id, count = 0;
+    char line[FILE_LEN], hash[HEX_HASH_SIZE + 1];
     chunk *c;
 
     /* open the getchunkfile */
@@ -69,14 +90,15 @@ Node *parse_chunkfile(Node **list, char *chunkfile) {
     while (fgets(line, FILE_LEN, f) != NULL) {
         if (sscanf(line, "%d %s\n", &id, hash) < 2) {
             fclose(f);
-            return *list;
+            return count;
         }
 
         c = create_chunk(id, (uint8_t *) hash);
         assert(c != NULL);
-        node_insert(list, c);
+        list_push_back(list, &(c->link));
+        count++;
     }
 
     fclose(f);
-    return *list;
+    return count;
 }
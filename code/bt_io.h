@@ -3,8 +3,9 @@
 
 #include <inttypes.h>
 #include <stdlib.h>
+#include <sys/types.h>
 
-#include "linkedlist.h"
+#include "list.h"
 #include "chunk.h"
 
 #define FILE_LEN 1024
@@ -20,11 +21,22 @@
  */
 size_t read_chunk_data_file_by_id(char *filename, unsigned id, uint8_t *buf);
 
+/*
+  \fn write_chunk_data_file_by_id(fd, id, buf)
+  \brief Write the data of the chunk with the given id at its offset in the
+  file fd with positional writes.
+
+  \return
+  	if successful: the number of bytes written
+    otherwise: -1
+ */
+ssize_t write_chunk_data_file_by_id(int fd, unsigned id, uint8_t *buf);
+
 /**
- * Parse the getchunkfile and store the ids and hashes of the chunks need
- * to be fetched from other peers.
+ * Parse the getchunkfile and append a chunk struct for each of the ids and
+ * hashes in it to list.
 
- @return if successful, a linked list of chunks struct; NULL otherwise.
+ @return the number of chunks appended.
  */
-Node *parse_chunkfile(Node **list, char *chunkfile);
+int parse_chunkfile(List *list, char *chunkfile);
 #endif
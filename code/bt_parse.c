@@ -12,21 +12,23 @@
 #include "debug.h"
 
 /* Option String */
-static const char* const _bt_optstring = "p:c:f:m:i:d:h";
+static const char* const _bt_optstring = "p:c:f:m:i:d:l:h";
 
 void bt_init(bt_config_t *config, int argc, char **argv) {
   bzero(config, sizeof(bt_config_t));
 
   strcpy(config->output_file, "output.dat");
   strcpy(config->peer_list_file, "nodes.map");
+  config->log_level = -1;
   config->argc = argc;
   config->argv = argv;
 }
 
 void bt_usage() {
   fprintf(stderr,
-	  "usage:  peer [-h] [-d <debug>] -p <peerfile> -c <chunkfile> -m <maxconn>\n"
-	  "            -f <master-chunk-file> -i <identity>\n");
+	  "usage:  peer [-h] [-d <debug>] [-l <loglevel>] -p <peerfile>\n"
+	  "            -c <chunkfile> -m <maxconn> -f <master-chunk-file>\n"
+	  "            -i <identity>\n");
 }
 
 void bt_help() {
@@ -38,6 +40,7 @@ void bt_help() {
 	  "         -m <maxconn>      Max # of downloads\n"
 	  "	    -f <master-chunk> The master chunk file\n"
 	  "         -i <identity>     Which peer # am I?\n"
+	  "         -l <loglevel>     0 error, 1 info, 2 debug, 3 trace\n"
 	  );
 }
 
@@ -91,6 +94,9 @@ void bt_parse_command_line(bt_config_t *config) {
     case 'i':
       config->identity = atoi(optarg);
       break;
+    case 'l':
+      config->log_level = atoi(optarg);
+      break;
     default:
       bt_usage();
       exit(-1);
@@ -116,6 +122,53 @@ void bt_parse_command_line(bt_config_t *config) {
   optind = old_optind;
 }
 
+/*
+  Slot of the peer map where the probe for the address starts.  The IPv4
+  address and port are packed into one 48-bit key and mixed with a
+  multiplicative hash.
+*/
+static unsigned peer_map_slot(const struct sockaddr_in *addr) {
+  uint64_t key = ((uint64_t) addr->sin_addr.s_addr << 16) | addr->sin_port;
+
+  return (unsigned) ((key * 0x9E3779B97F4A7C15ULL) >> 32) &
+    (BT_PEER_MAP_SIZE - 1);
+}
+
+static int peer_addr_equal(const struct sockaddr_in *a,
+                           const struct sockaddr_in *b) {
+  return a->sin_addr.s_addr == b->sin_addr.s_addr &&
+    a->sin_port == b->sin_port;
+}
+
+/*
+  Add the peer to the peer map; a later peer with the same address replaces
+  an earlier one.
+*/
+static void peer_map_insert(bt_config_t *config, bt_peer_t *peer) {
+  unsigned i = peer_map_slot(&peer->addr);
+
+  while (config->peer_map[i] != NULL &&
+         !peer_addr_equal(&config->peer_map[i]->addr, &peer->addr))
+    i = (i + 1) & (BT_PEER_MAP_SIZE - 1);
+
+  config->peer_map[i] = peer;
+}
+
+bt_peer_t *bt_peer_by_addr(const bt_config_t *config,
+                           const struct sockaddr_in *addr) {
+  unsigned i = peer_map_slot(addr);
+  bt_peer_t *p;
+
+  /* the map is at most half full, so an empty slot ends every probe */
+  while ((p = config->peer_map[i]) != NULL) {
+    if (peer_addr_equal(&p->addr, addr))
+      return p;
+    i = (i + 1) & (BT_PEER_MAP_SIZE - 1);
+  }
+
+  return NULL;
+}
+
 /*
   Read through .map file and extract the peers as well as create the addr
   struct.
@@ -124,7 +177,7 @@ void bt_parse_peer_list(bt_config_t *config) {
   FILE *f;
   bt_peer_t *node;
   char line[BT_FILENAME_LEN], hostname[BT_FILENAME_LEN];
-  int nodeid, port;
+  int nodeid, port, npeers = 0;
   struct hostent *host;
 
   assert(config != NULL);
@@ -136,6 +189,12 @@ void bt_parse_peer_list(bt_config_t *config) {
     if (line[0] == '#') continue;
     assert(sscanf(line, "%d %s %d", &nodeid, hostname, &port) != 0);
 
+    if (++npeers > BT_MAX_PEERS) {
+      fprintf(stderr, "bt_parse error:  More than %d peers in %s!\n",
+              BT_MAX_PEERS, config->peer_list_file);
+      exit(-1);
+    }
+
     node = (bt_peer_t *) calloc(1, sizeof(bt_peer_t));
     assert(node != NULL);
 
@@ -149,6 +208,7 @@ void bt_parse_peer_list(bt_config_t *config) {
 
     node->next = config->peers;
     config->peers = node;
+    peer_map_insert(config, node);
 
     node->available = 1;
   }
@@ -8,6 +8,7 @@
 
 #define BT_FILENAME_LEN 255
 #define BT_MAX_PEERS 1024
+#define BT_PEER_MAP_SIZE (2 * BT_MAX_PEERS) /* a power of two */
 
 typedef struct bt_peer_s {
     mytime_t timer; /* records the transfer time of the peer */
@@ -27,11 +28,15 @@ struct bt_config_s {
     int   max_conn;
     short identity;
     unsigned short myport;
+    int   log_level; /* run time log level, -1 for the built in one */
 
     int argc;
     char **argv;
 
     bt_peer_t *peers;
+
+    /* open addressing table of the peers keyed by (IPv4, port) */
+    bt_peer_t *peer_map[BT_PEER_MAP_SIZE];
 };
 typedef struct bt_config_s bt_config_t;
 
@@ -41,5 +46,7 @@ void bt_parse_command_line(bt_config_t *c);
 void bt_parse_peer_list(bt_config_t *c);
 void bt_dump_config(bt_config_t *c);
 bt_peer_t *bt_peer_info(const bt_config_t *c, int peer_id);
+bt_peer_t *bt_peer_by_addr(const bt_config_t *c,
+                           const struct sockaddr_in *addr);
 
 #endif /* _BT_PARSE_H_ */
@@ -14,47 +14,75 @@
 #include "hash.h"
 #include "chunk.h"
 #include "transfer.h"
+#include "transfer_table.h"
 #include "congestion.h"
 
 #define MAX_DUP_ACKS 3
 
-static Node *transfers; /* a linked list of current data transfers (outgoing) */
-static void adjust_window(Transfer *transfer, uint32_t new_index);
+static TransferTable transfers; /* current data transfers (outgoing) */
+static void handle_transfer_timeout(Timer *timer, void *arg);
+
+int server_init(void) {
+    return transfer_table_init(&transfers);
+}
 
 /*
-  Handles when the select call timeout:
-  1) loop through transfers and handle any time'd out Transfers
+  Remove a transfer from the transfer table and free it.
 */
-void handle_server_timeout(bt_config_t *config) {
-    Node *node, *next;
-    Transfer *transfer;
+static void remove_transfer(Transfer *transfer) {
+    transfer_table_remove(&transfers, transfer);
+    delete_transfer(transfer);
+}
 
-    config = config; /* quiet GCC compilation */
+/*
+  Drop the transfer to peer if it is for another chunk than c.
 
-    if (!node_length(transfers)) {
-        return;
+  The table holds one transfer per peer, and ACKs are matched to their
+  transfer by peer alone, as they always were.  A client downloads one
+  chunk from a peer at a time and only sends another GET once it has given
+  up on the current one, so the old transfer would otherwise keep its slot
+  and its timer until it timed out, and block the new GET.
+*/
+static void drop_abandoned_transfer(bt_peer_t *peer, chunk *c) {
+    Transfer *transfer = transfer_table_find_by_peer(&transfers, peer);
+
+    if (transfer != NULL && transfer->c != c) {
+        LOG("Peer (%u) gave up on chunk (%u).\n", peer->id, transfer->c->id);
+        remove_transfer(transfer);
     }
+}
 
-    /* check the transfers and handle any timeout transfers */
-    for (node = transfers; node != NULL; node = next) {
+/*
+  Handles the timeout of the outgoing transfer arg.
+*/
+static void handle_transfer_timeout(Timer *timer, void *arg) {
+    Transfer *transfer = arg;
 
-        /* Server only cares about sending requested data,
-           just delete the transfer
-        */
-        next = node->next;
-        transfer = node->data;
+    timer = timer; /* quiet GCC compilation */
 
-        if (transfer_has_timeout(transfer)) {
-            if (++(transfer->cctrl.timeout_count) >= MAX_TO_COUNTS) {
-                LOG("transfer have (%u) died!!!\n",
-                           ((Transfer *) node->data)->peer->id);
-                node_delete(&(transfers), node, delete_transfer);
-            }
-            else {
-                detected_first_loss(transfer);
-            }
-        }
+    LOG_INFO("Transfer to peer (%u) for chunk (%u) has timedout.\n",
+        transfer->peer->id, transfer->c->id);
+
+    /* Server only cares about sending requested data,
+       just delete the transfer
+    */
+    if (++(transfer->cctrl.timeout_count) >= MAX_TO_COUNTS) {
+        LOG_INFO("transfer have (%u) died!!!\n", transfer->peer->id);
+        remove_transfer(transfer);
+        return;
     }
+
+    /* everything in flight is taken as lost and the window collapses, so
+       the oldest unacknowledged packet is sent again at once; the timer
+       waits twice as long for its ACK */
+    rtt_backoff(&(transfer->cctrl.rtt));
+    detected_timeout(transfer);
+    scoreboard_timeout(transfer->cctrl.board);
+
+    transfer->pending = 0;
+    send_DATA(transfer);
+
+    transfer_touch(transfer);
 }
 
 /**
@@ -87,43 +115,84 @@ void send_IHAVE(bt_peer_t *peer, uint8_t **bin_hash_list,
 }
 
 /*
-  Send the data chunk in chunk c to the peer.
+  Add the packet seq_num of the transfer to the burst, and send the burst
+  once it is full.
 */
-void send_DATA(Transfer *transfer) {
-    Packet packet;
-    unsigned index; /* index into the data */
-    chunk *c = transfer->c;
+static void burst_add(Transfer *transfer, DataSegment *burst,
+                      unsigned *count, uint32_t seq_num) {
+    unsigned index = (seq_num - 1) * DATA_SIZE; /* index into the data */
+
+    /* the payload is sent straight from the chunk data */
+    burst[*count].seq_num = seq_num;
+    burst[*count].data = transfer->c->chunk_data + index;
+
+    if (BT_CHUNK_SIZE - index < DATA_SIZE) {
+        /* last bit of data */
+        burst[*count].data_len = BT_CHUNK_SIZE - index;
+    } else {
+        burst[*count].data_len = DATA_SIZE;
+    }
 
-    transfer->cctrl.dup_count = 0;
+    LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE, "Send DATA (%d)\n", seq_num);
 
-    /* continue to send data chunks until sliding window is complete */
-    while (transfer->cctrl.index < MAX_SEQ_NUM && /* end of the data chunk */
-           transfer->cctrl.index < transfer->cctrl.begin +
-           transfer->cctrl.wind_size) { /* sliding window */
+    /* the whole window goes out in as few syscalls as possible */
+    if (++(*count) == MAX_DATA_BURST) {
+        send_data_to_peer(sock, transfer->peer, burst, *count);
+        *count = 0;
+    }
+}
 
-        memset(&packet, 0, sizeof(Packet));
+/*
+  Send the data chunk in chunk c to the peer: resend the packets marked lost,
+  oldest first, then send new ones, for as long as fewer than the window
+  size are in flight.
+*/
+void send_DATA(Transfer *transfer) {
+    DataSegment burst[MAX_DATA_BURST];
+    Scoreboard *sb = transfer->cctrl.board;
+    unsigned count = 0;
+    uint32_t seq_num;
+
+    while (sb->in_flight < transfer->cctrl.wind_size) {
+        if ((seq_num = scoreboard_next_lost(sb)) == 0) {
+            /* end of the data chunk */
+            if (sb->high_sent == MAX_SEQ_NUM) {
+                break;
+            }
+            seq_num = sb->high_sent + 1;
+        }
 
-        packet.type = DATA;
-        packet.header_len = STANDARD_HEADER_LEN;
+        scoreboard_sent(sb, seq_num);
+        burst_add(transfer, burst, &count, seq_num);
+    }
 
-        /* Load data from chunk into packet */
-        index = transfer->cctrl.index * DATA_SIZE;
+    if (count > 0) {
+        send_data_to_peer(sock, transfer->peer, burst, count);
+    }
+}
 
-        if (BT_CHUNK_SIZE - index < DATA_SIZE) {
-            /* last bit of data */
-            memcpy(packet.data, c->chunk_data + index, BT_CHUNK_SIZE - index);
-            packet.packet_len = STANDARD_HEADER_LEN + (BT_CHUNK_SIZE - index);
-        } else {
-            memcpy(packet.data, c->chunk_data + index, DATA_SIZE);
-            packet.packet_len = STANDARD_HEADER_LEN + DATA_SIZE;
-        }
+/*
+  Send the DATA owed by the transfers whose window moved during the last
+  receive batch.  Congestion control is updated once per transfer per batch.
+*/
+void send_pending_DATA(void) {
+    Transfer *transfer;
+    unsigned i;
 
-        transfer->cctrl.index++;
-        packet.seq_num = transfer->cctrl.index;
+    for (i = 0; i < transfers.count; i++) {
+        transfer = transfers.items[i];
 
-        LOG("Send DATA (%d)\n", packet.seq_num);
+        if (!transfer->pending) {
+            continue;
+        }
+
+        if (transfer->cctrl.new_acks > 0) {
+            congestion_control(transfer);
+            transfer->cctrl.new_acks = 0;
+        }
 
-        send_packet_to_peer(sock, &packet, transfer->peer);
+        transfer->pending = 0;
+        send_DATA(transfer);
     }
 }
 
@@ -135,7 +204,10 @@ void send_DENIED(bt_peer_t *peer) {
 
     packet.type = DENIED;
     packet.header_len = STANDARD_HEADER_LEN;
-    packet.packet_len = packet.header_len;
+    packet.packet_len = STANDARD_HEADER_LEN + HEADER_PAD_LEN;
+    packet.seq_num = 0;
+    packet.ack_num = 0;
+    packet.hash_num = 0;
 
     send_packet_to_peer(sock, &packet, peer);
 }
@@ -146,40 +218,58 @@ void send_DENIED(bt_peer_t *peer) {
   Read the hash contained in the GET packet, check that the hash matches, and
   construct DATA packet from the actual data chunk, and send the packet.
 */
-void receive_GET(Packet* pack, bt_peer_t *peer, int max_conn) {
-    uint8_t *bin_hash = pack->hash_list[0];
-    Node *chunk_node;
+void receive_GET(PacketView *pack, bt_peer_t *peer, int max_conn) {
+    uint8_t *bin_hash = packet_view_hash(pack, 0);
     chunk *c;
     Transfer *transfer;
 
-    chunk_node = node_find(have, compare_chunk_by_bin_wrapper, bin_hash);
+    if (packet_view_hash_num(pack) < 1) {
+        LOG("GET from peer (%u) carries no hash.\n", peer->id);
+        return;
+    }
+
+    c = chunk_set_find(&have_set, bin_hash);
 
-    if (chunk_node == NULL) {
+    if (c == NULL) {
         /* seq_num of 0 tells GET sender requested chunk is not found */
-        LOG("Failed to find chunk that should be owned by self"
+        LOG_INFO("Failed to find chunk that should be owned by self"
                    " in receive GET.\n");
         send_DENIED(peer);
         return;
     }
 
-    c = (chunk *) (chunk_node->data);
     LOG("Peer (%u) for chunk (%d)\n", peer->id, c->id);
 
-    if (count_node(&(transfers)) >= max_conn) {
+    /* a GET for another chunk replaces the peer's transfer */
+    drop_abandoned_transfer(peer, c);
+
+    if ((int) transfers.count >= max_conn) {
         /* seq_num >= 1 tells GET sender max number of transfers is reached */
         LOG("Reached max number of transfers.\n");
         send_DENIED(peer);
         return;
     }
 
-    if (!node_find(transfers, compare_transfer_by_chunk_hash, bin_hash)) {
+    if (transfer_table_find_by_chunk(&transfers, bin_hash) == NULL) {
         /* only create transfer if chunk is not in flight */
 
-        if ((transfer = create_transfer(peer, c)) != NULL) {
-            /* create the transfer node in the outgoing transfer list */
-            node_insert(&(transfers), transfer);
-            send_DATA(transfer);
+        if ((transfer = create_transfer(peer, c)) == NULL) {
+            return;
+        }
+
+        if ((transfer->cctrl.board = scoreboard_alloc()) == NULL) {
+            delete_transfer(transfer);
+            return;
+        }
+
+        /* add the transfer to the outgoing transfer table */
+        if (transfer_table_insert(&transfers, transfer) < 0) {
+            delete_transfer(transfer);
+            return;
         }
+
+        transfer_set_timeout(transfer, handle_transfer_timeout, transfer);
+        send_DATA(transfer);
     }
 }
 
@@ -187,28 +277,25 @@ void receive_GET(Packet* pack, bt_peer_t *peer, int max_conn) {
  * Process the WHOHAS packets recieved, prepare to send back a reply to the
  * peer.
  */
-void receive_WHOHAS(Packet *pack, bt_peer_t *peer) {
+void receive_WHOHAS(PacketView *pack, bt_peer_t *peer) {
     uint8_t *bin_hash_list[MAX_HASH_IN_PACKET];
     chunk *c;
     int i, found = 0;
-    Node* node;
 
     LOG("Receive WHOHAS from peer (%u).\n", peer->id);
 
     /*
-      loops through every hash in the WHOHAS packet and tries to find a
-      match in hahes already have
+      loops through every hash in the WHOHAS packet and looks it up in the
+      chunks already have
 
       if so, the hash is added to a IHAVE list
     */
-    for (i = 0; i < pack->hash_num; i++) {
-        for (node = have; node != NULL; node = node->next) {
-            c = node->data;
+    for (i = 0; i < packet_view_hash_num(pack); i++) {
+        c = chunk_set_find(&have_set, packet_view_hash(pack, i));
 
-            /* add to the hash list of the IHAVE packet if it is owned */
-            if (compare_bin_hash(c->bin_hash, pack->hash_list[i]) == 1) {
-                bin_hash_list[found++] = c->bin_hash;
-            }
+        /* add to the hash list of the IHAVE packet if it is owned */
+        if (c != NULL) {
+            bin_hash_list[found++] = c->bin_hash;
         }
     }
 
@@ -222,62 +309,96 @@ void receive_WHOHAS(Packet *pack, bt_peer_t *peer) {
 
   This function affects the slow start congestion control algorithm
 */
-void receive_ACK(Packet *pack, bt_peer_t *peer) {
+void receive_ACK(PacketView *pack, bt_peer_t *peer) {
     Transfer *transfer;
-    Node *transfer_node;
+    uint32_t ack_num = packet_view_ack_num(pack);
+    Scoreboard *sb;
+    unsigned delivered, newly_acked;
+    nstime_t rtt;
 
-    transfer_node = node_find(transfers, compare_transfer_by_peer_id, peer);
+    transfer = transfer_table_find_by_peer(&transfers, peer);
 
-    if (transfer_node == NULL) {
-        LOG("Failed to find transfer for ACK'd peer (%u)."
+    if (transfer == NULL) {
+        LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE,
+            "Failed to find transfer for ACK'd peer (%u)."
                    "\n", peer->id);
         return;
     }
 
-    LOG("Receive ACK (%d) from peer (%u).\n", pack->ack_num, peer->id);
+    LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE, "Receive ACK (%d) from peer (%u).\n",
+                      ack_num, peer->id);
 
-    transfer = transfer_node->data;
+    sb = transfer->cctrl.board;
+    delivered = scoreboard_ack(sb, ack_num,
+                               packet_view_sack(pack),
+                               packet_view_sack_len(pack), &rtt);
+
+    if (rtt > 0) {
+        rtt_sample(&(transfer->cctrl.rtt), rtt);
+    }
 
     /* The last ACK number is received */
-    if (pack->ack_num == MAX_SEQ_NUM) {
-        LOG("Transfer complete chunk (%u).\n", transfer->c->id);
-        node_delete(&transfers, transfer_node, delete_transfer);
+    if (ack_num == MAX_SEQ_NUM) {
+        LOG_INFO("Transfer complete chunk (%u), (%u) packets resent.\n",
+                 transfer->c->id, sb->retransmits);
+        remove_transfer(transfer);
         return;
     }
 
+    /* delivered packets leave room in the window for more DATA */
+    if (delivered > 0) {
+        transfer->pending = 1;
+    }
+
     /* Non-duplicated ACK */
-    if (pack->ack_num > transfer->cctrl.begin) {
-        adjust_window(transfer, pack->ack_num);
-        congestion_control(transfer);
-        send_DATA(transfer);
+    if (ack_num > transfer->cctrl.begin) {
+        newly_acked = ack_num - transfer->cctrl.begin;
+        transfer->cctrl.begin = ack_num;
+        transfer->cctrl.dup_count = 0;
+
+        if (transfer->cctrl.congest_state == FR) {
+            /* a partial ACK stops just short of the next lost packet */
+            if (fast_recovery_ack(transfer, ack_num, newly_acked)) {
+                scoreboard_mark_lost(sb, ack_num + 1);
+            }
+        }
+        else {
+            /* the window is grown and refilled once per receive batch */
+            transfer->cctrl.new_acks++;
+        }
+
+        transfer->pending = 1;
     }
 
     /* A duplicate ACK number is received */
-    else if (pack->ack_num == transfer->cctrl.begin) {
+    else if (ack_num == transfer->cctrl.begin) {
         transfer->cctrl.dup_count++;
 
-        if (transfer->cctrl.dup_count >= MAX_DUP_ACKS) {
-            /* Resend the data of SEQ number from next expected ACK number */
-            LOG("Got 3 duplicates of ACK (%d).\n", pack->ack_num);
-
-            transfer->cctrl.index = transfer->cctrl.begin;
-            detected_first_loss(transfer);
-            send_DATA(transfer);
+        /* a duplicate ACK without SACKs still means a packet has left the
+           network, which the scoreboard cannot see */
+        if (transfer->cctrl.congest_state == FR && delivered == 0) {
+            fast_recovery_dup_ack(transfer);
+            transfer->pending = 1;
         }
     }
 
-    transfer->cctrl.timeout_count = 0;
-    millitime(&(transfer->timestamp));
-}
-
-/*
-  Shifts the congestion window to the most recent ACKed packet.
-*/
-static void adjust_window(Transfer *transfer, uint32_t new_index) {
-    transfer->cctrl.begin = new_index;
-
-    /* update next packet to be sent if it is outside of the new window */
-    if (transfer->cctrl.begin > transfer->cctrl.index) {
-        transfer->cctrl.index = transfer->cctrl.begin;
+    /* a loss is detected by three duplicate ACKs, or by the SACKs; only
+       one fast recovery runs at a time, and none before everything sent
+       before the last timeout is acknowledged */
+    if (transfer->cctrl.congest_state != FR &&
+        transfer->cctrl.begin >= transfer->cctrl.recover &&
+        (transfer->cctrl.dup_count >= MAX_DUP_ACKS || sb->lost > 0)) {
+        LOG("Loss detected after ACK (%d).\n", transfer->cctrl.begin);
+
+        /* without SACKs, the packet after the ACK is the one lost; with
+           them, the scoreboard has already marked what is missing */
+        scoreboard_mark_lost(sb, transfer->cctrl.begin + 1);
+        fast_recovery_start(transfer, (delivered == 0) ?
+                            transfer->cctrl.dup_count : 0);
+        transfer->cctrl.dup_count = 0;
+        transfer->pending = 1;
     }
+
+    transfer->cctrl.timeout_count = 0;
+    transfer_touch(transfer);
 }
@@ -9,15 +9,21 @@
 #include "packet.h"
 #include "transfer.h"
 
-void handle_server_timeout(bt_config_t *config);
+/*
+  Set up the server side state.
+
+  Returns 0 if successful, -1 otherwise.
+*/
+int server_init(void);
 
 /* Receiving functions */
-void receive_GET(Packet* pack, bt_peer_t *peer, int max_conn);
-void receive_WHOHAS(Packet* pack, bt_peer_t *peer);
-void receive_ACK(Packet *pack, bt_peer_t *peer);
+void receive_GET(PacketView *pack, bt_peer_t *peer, int max_conn);
+void receive_WHOHAS(PacketView *pack, bt_peer_t *peer);
+void receive_ACK(PacketView *pack, bt_peer_t *peer);
 
 /* Sending functions */
 void send_DATA(Transfer *transfer);
+void send_pending_DATA(void);
 void send_DENIED(bt_peer_t *peer);
 void send_IHAVE(bt_peer_t *peer, uint8_t **bin_hash_list,
                 unsigned hash_list_len);
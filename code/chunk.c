@@ -5,34 +5,117 @@
 #include "hash.h"
 #include "bt_parse.h"
 #include "log.h"
+#include "slab.h"
 #include <ctype.h>
 #include <assert.h>
 #include <stdlib.h> // for malloc
 #include <string.h> // for memset
+#include <sys/mman.h> // for munmap
 
-chunk *create_chunk(uint8_t id, uint8_t *hash) {
+static SlabCache chunk_cache;
+static SlabCache received_cache; /* download state of chunks */
+static int chunk_cache_ready;
+
+chunk *create_chunk(unsigned id, uint8_t *hash) {
     chunk *c;
 
+    if (!chunk_cache_ready) {
+        slab_cache_init(&chunk_cache, "chunk", sizeof(chunk), SLAB_HUGEPAGES);
+        slab_cache_init(&received_cache, "received", sizeof(Bitset),
+                        SLAB_HUGEPAGES);
+        chunk_cache_ready = 1;
+    }
+
     /* create a new chunk for later to get data from peers*/
-    if ((c = (chunk*) calloc(1, sizeof(chunk))) == NULL) {
-        LOG("Failed to calloc for chunk.");
+    if ((c = (chunk*) slab_alloc(&chunk_cache)) == NULL) {
+        LOG_ERROR("Failed to allocate a chunk.");
+        return NULL;
     }
 
     c->id = id;
+    vector_init(&(c->peers));
 
-    /* stores both the bin and hax hash to chunk struct */
+    /* only the bin hash is kept; the hex hash is rebuilt for logging */
     hex2binary((char *) hash, HEX_HASH_SIZE, c->bin_hash);
-    memcpy(c->hex_hash, hash, HEX_HASH_SIZE);
 
     return c;
 }
 
+int chunk_alloc_data(chunk *c) {
+    if ((c->received = slab_alloc(&received_cache)) == NULL) {
+        LOG_ERROR("Failed to allocate received bits for chunk (%u).\n", c->id);
+        return EXIT_FAILURE;
+    }
+
+    if ((c->chunk_data = calloc(1, BT_CHUNK_SIZE)) == NULL) {
+        LOG_ERROR("Failed to calloc data for chunk (%u).\n", c->id);
+        slab_free(&received_cache, c->received);
+        c->received = NULL;
+        c->data_type = CHUNK_DATA_NONE;
+        return EXIT_FAILURE;
+    }
+
+    bitset_init(c->received, MAX_SEQ_NUM);
+    c->data_type = CHUNK_DATA_HEAP;
+    return EXIT_SUCCESS;
+}
+
+void chunk_free_data(chunk *c) {
+    /* chunk store slices are unmapped together with the store */
+    if (c->data_type == CHUNK_DATA_HEAP) {
+        free(c->chunk_data);
+    } else if (c->data_type == CHUNK_DATA_MAPPED) {
+        munmap(c->chunk_data, BT_CHUNK_SIZE);
+    }
+
+    /* the received bits only matter while the data is downloaded */
+    slab_free(&received_cache, c->received);
+    c->received = NULL;
+
+    c->chunk_data = NULL;
+    c->data_type = CHUNK_DATA_NONE;
+}
+
+int chunk_add_output(chunk *c, unsigned id) {
+    unsigned *more;
+
+    if (c->output_count == 0) {
+        c->first_output = id;
+    }
+    else {
+        /* listing a chunk twice is rare, so grow one id at a time */
+        more = realloc(c->more_outputs, c->output_count * sizeof(unsigned));
+
+        if (more == NULL) {
+            LOG_ERROR("Failed to record output id %u of chunk (%u).\n",
+                      id, c->id);
+            return EXIT_FAILURE;
+        }
+
+        more[c->output_count - 1] = id;
+        c->more_outputs = more;
+    }
+
+    c->output_count++;
+    return EXIT_SUCCESS;
+}
+
+unsigned chunk_output_id(chunk *c, unsigned i) {
+    return (i == 0) ? c->first_output : c->more_outputs[i - 1];
+}
+
+void chunk_clear_outputs(chunk *c) {
+    free(c->more_outputs);
+    c->more_outputs = NULL;
+    c->output_count = 0;
+}
+
 bt_peer_t* find_first_available_peer(chunk* c) {
-    Node* node;
+    unsigned i;
     bt_peer_t* peer;
     /* loops through each peer to see if they are available */
-    for (node = c->peer; node != NULL; node = node->next) {
-        peer = node->data;
+    for (i = 0; i < c->peers.size; i++) {
+        peer = c->peers.items[i];
         if (peer->available == 1) {
             return peer;
         }
@@ -40,8 +123,18 @@ bt_peer_t* find_first_available_peer(chunk* c) {
     return NULL;
 }
 
+const char *chunk_hex_hash(chunk *c) {
+    static char hex_hash[HEX_HASH_SIZE + 1];
+
+    binary2hex(c->bin_hash, BIN_HASH_SIZE, hex_hash);
+    return hex_hash;
+}
+
 int compare_chunk_by_hex_hash(chunk *c, char *hex_hash) {
-    return compare_hex_hash(c->hex_hash, hex_hash);
+    uint8_t bin_hash[BIN_HASH_SIZE];
+
+    hex2binary(hex_hash, HEX_HASH_SIZE, bin_hash);
+    return compare_bin_hash(c->bin_hash, bin_hash);
 }
 
 int compare_chunk_by_bin_hash(chunk *c, uint8_t *bin_hash) {
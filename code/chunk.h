@@ -3,14 +3,21 @@
 #include <stdio.h>
 #include <inttypes.h>
 
-#include "linkedlist.h"
+#include "list.h"
+#include "vector.h"
 #include "hash.h"
 #include "bt_parse.h"
 #include "packet.h"
+#include "bitset.h"
 
 #define BT_CHUNK_SIZE (512 * 1024)
 #define DATA_SIZE 1000
 #define MAX_SEQ_NUM (BT_CHUNK_SIZE / DATA_SIZE) + 1
+#define CHUNK_CACHE_LINE 64
+
+#if MAX_SEQ_NUM > BITSET_MAX_BITS
+#error "a chunk has more packets than a Bitset can track"
+#endif
 
 #define ascii2hex(ascii,len,buf) hex2binary((ascii),(len),(buf))
 #define hex2ascii(buf,len,ascii) binary2hex((buf),(len),(ascii))
@@ -19,34 +26,86 @@
 extern "C" {
 #endif
 
+    /* where the data of a chunk lives */
+    enum chunk_data_type {
+        CHUNK_DATA_NONE, /* no data attached yet */
+        CHUNK_DATA_STORE, /* a read-only slice of the chunk store mapping */
+        CHUNK_DATA_HEAP, /* a heap buffer the chunk is downloaded into */
+        CHUNK_DATA_MAPPED /* a read-only mapping of the chunk in a file */
+    };
+
+    /*
+      The metadata of a chunk.  It is kept to two cache lines, with the
+      fields used when walking chunks (the hash, the list link, the peers)
+      first, so scans over the have and missing lists stay in cache.  The
+      data and the received bits live elsewhere and are only attached while
+      they are needed.
+    */
     typedef struct chunk {
-        unsigned int id; /* records the position of the chunk in file */
-        char hex_hash[HEX_HASH_SIZE + 1]; /* records the hex hash of the chunk
-                                           * (40 bytes + 1 for \0) */
         uint8_t bin_hash[BIN_HASH_SIZE]; /* bin hash of the chunk (20 bytes) */
-        uint8_t chunk_data[BT_CHUNK_SIZE]; /* the actual data of the chunk */
+        unsigned int id; /* records the position of the chunk in file */
+        ListLink link; /* on the have or the missing list */
+        Vector peers; /* the peers known to own the chunk */
+        enum chunk_data_type data_type; /* who owns chunk_data */
+        uint8_t *chunk_data; /* the actual data of the chunk */
 
-        /* An array where the (i-1)th index represent whether or not the ith sequence
-         * number has been received.
+        /* While the chunk is downloaded into the heap, a bitset where the
+         * (i-1)th bit represent whether or not the ith sequence number has
+         * been received; NULL otherwise.
 
-         example: if the seq_num 5 has been received, then chunk_bits[5-1] == 1.
-         If it has not been received, then it should be 0.
+         example: if the seq_num 5 has been received, then bit 5-1 is set.
+         Its low-water mark is the largest in order sequence number.
         */
-        uint8_t bits[MAX_SEQ_NUM];
-        int bits_count;
+        Bitset *received;
 
-        Node *peer;
-    } chunk;
+        /* The ids of the chunk in the output file of the current GET.  A hash
+         * listed more than once is fetched once and written at each of them;
+         * the first id is kept inline and the rest go to the heap. */
+        unsigned output_count;
+        unsigned first_output;
+        unsigned *more_outputs;
+    } __attribute__((aligned(CHUNK_CACHE_LINE))) chunk;
 
 	/**
        Given a chunk id and hash, create a chunk structure to hold the data
-       @return a dynamically allocated chunk struct if successful.  NULL otherwise.
+       @return a chunk struct taken from the chunk slab if successful.  NULL
+       otherwise.
+    */
+    chunk *create_chunk(unsigned id, uint8_t *hash);
+
+    /*
+      Attach a zeroed heap buffer of BT_CHUNK_SIZE bytes and cleared received
+      bits to the chunk so that it can be downloaded into.
+
+      @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise.
     */
-    chunk *create_chunk(uint8_t id, uint8_t *hash);
+    int chunk_alloc_data(chunk *c);
+
+    /* Detach the data and the received bits from the chunk, freeing or
+       unmapping the data if it is owned by the chunk. */
+    void chunk_free_data(chunk *c);
+
+    /*
+      Record that the chunk goes at id in the output file, in addition to
+      the ids already recorded.
+
+      @return EXIT_SUCCESS if successful, EXIT_FAILURE otherwise.
+    */
+    int chunk_add_output(chunk *c, unsigned id);
+
+    /* Return the ith id recorded by chunk_add_output, i < c->output_count. */
+    unsigned chunk_output_id(chunk *c, unsigned i);
+
+    /* Forget the ids recorded by chunk_add_output. */
+    void chunk_clear_outputs(chunk *c);
 
     /* Find the first available peer from peer linked list in a chunk. */
     bt_peer_t* find_first_available_peer(chunk* c);
 
+    /* Return the hex hash of chunk c, for logging.  The string is rebuilt
+       in a static buffer that the next call overwrites. */
+    const char *chunk_hex_hash(chunk *c);
+
     /* return 1 if the hex_hash matches the hex in chunk c; 0 otherwise */
     int compare_chunk_by_hex_hash(chunk *c, char *hex_hash);
 
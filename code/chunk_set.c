@@ -0,0 +1,129 @@
+/*
+  Open addressing hash table of chunks keyed by binary hash
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "chunk_set.h"
+#include "hash.h"
+#include "log.h"
+
+/* the bucket of a hash; SHA-1 output needs no further mixing */
+static size_t bucket_of(ChunkSet *set, uint8_t *bin_hash) {
+    uint64_t bits;
+
+    memcpy(&bits, bin_hash, sizeof(bits));
+    return (size_t) bits & set->mask;
+}
+
+/*
+  Returns the slot holding the hash, or the empty slot ending its probe
+  sequence if it is not in the set.
+*/
+static size_t probe(ChunkSet *set, uint8_t *bin_hash) {
+    size_t i = bucket_of(set, bin_hash);
+
+    while (set->slots[i] != NULL &&
+           memcmp(set->slots[i]->bin_hash, bin_hash, BIN_HASH_SIZE) != 0) {
+        i = (i + 1) & set->mask;
+    }
+
+    return i;
+}
+
+/*
+  Double the capacity of the table and rehash every chunk.
+*/
+static int grow(ChunkSet *set) {
+    chunk **old_slots = set->slots;
+    size_t old_capacity = set->mask + 1;
+    size_t i;
+
+    set->slots = calloc(old_capacity * 2, sizeof(chunk *));
+
+    if (set->slots == NULL) {
+        LOG_ERROR("Failed to grow chunk set to (%zu) slots.\n",
+                  old_capacity * 2);
+        set->slots = old_slots;
+        return -1;
+    }
+
+    set->mask = old_capacity * 2 - 1;
+
+    for (i = 0; i < old_capacity; i++) {
+        if (old_slots[i] != NULL) {
+            set->slots[probe(set, old_slots[i]->bin_hash)] = old_slots[i];
+        }
+    }
+
+    free(old_slots);
+    return 0;
+}
+
+int chunk_set_init(ChunkSet *set) {
+    set->slots = calloc(CHUNK_SET_MIN_CAPACITY, sizeof(chunk *));
+    set->mask = CHUNK_SET_MIN_CAPACITY - 1;
+    set->count = 0;
+
+    if (set->slots == NULL) {
+        LOG_ERROR("Failed to allocate chunk set.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int chunk_set_insert(ChunkSet *set, chunk *c) {
+    size_t i;
+
+    /* keep the load factor at most 1/2 so probe sequences stay short */
+    if ((set->count + 1) * 2 > set->mask + 1 && grow(set) < 0) {
+        return -1;
+    }
+
+    i = probe(set, c->bin_hash);
+
+    if (set->slots[i] == NULL) {
+        set->slots[i] = c;
+        set->count++;
+    }
+
+    return 0;
+}
+
+chunk *chunk_set_find(ChunkSet *set, uint8_t *bin_hash) {
+    return set->slots[probe(set, bin_hash)];
+}
+
+chunk *chunk_set_remove(ChunkSet *set, uint8_t *bin_hash) {
+    size_t hole = probe(set, bin_hash);
+    size_t i, home;
+    chunk *c = set->slots[hole];
+
+    if (c == NULL) {
+        return NULL;
+    }
+
+    /* shift the rest of the cluster back so that no probe sequence is
+       broken by the hole, instead of leaving a tombstone */
+    for (i = (hole + 1) & set->mask; set->slots[i] != NULL;
+         i = (i + 1) & set->mask) {
+        home = bucket_of(set, set->slots[i]->bin_hash);
+
+        /* the entry can move if its home is not in (hole, i] */
+        if (((i - home) & set->mask) >= ((i - hole) & set->mask)) {
+            set->slots[hole] = set->slots[i];
+            hole = i;
+        }
+    }
+
+    set->slots[hole] = NULL;
+    set->count--;
+    return c;
+}
+
+void chunk_set_clear(ChunkSet *set) {
+    memset(set->slots, 0, (set->mask + 1) * sizeof(chunk *));
+    set->count = 0;
+}
@@ -0,0 +1,56 @@
+/*
+  A set of chunks indexed by binary hash.  The table uses open addressing
+  with linear probing, and since a SHA-1 hash is already uniformly
+  distributed its first bytes are used directly as the bucket index.  A
+  lookup costs one or two probes however many chunks are in the set.
+*/
+
+#ifndef CHUNK_SET_H
+#define CHUNK_SET_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#include "chunk.h"
+
+#define CHUNK_SET_MIN_CAPACITY 64 /* must be a power of two */
+
+typedef struct {
+    chunk **slots; /* NULL marks an empty slot */
+    size_t mask; /* capacity - 1, the capacity is a power of two */
+    size_t count; /* number of chunks in the set */
+} ChunkSet;
+
+/*
+  Initialize an empty set.
+
+  Returns 0 if successful, -1 otherwise.
+*/
+int chunk_set_init(ChunkSet *set);
+
+/*
+  Add the chunk to the set.  A set holds at most one chunk per hash, so
+  nothing is added if a chunk with the same hash is already in it.
+
+  Returns 0 if successful, -1 if the table could not grow.
+*/
+int chunk_set_insert(ChunkSet *set, chunk *c);
+
+/*
+  Returns the chunk with the given binary hash, NULL if it is not in the set.
+*/
+chunk *chunk_set_find(ChunkSet *set, uint8_t *bin_hash);
+
+/*
+  Remove the chunk with the given binary hash from the set.
+
+  Returns the removed chunk, NULL if it was not in the set.
+*/
+chunk *chunk_set_remove(ChunkSet *set, uint8_t *bin_hash);
+
+/*
+  Remove every chunk from the set.  The chunks themselves are not freed.
+*/
+void chunk_set_clear(ChunkSet *set);
+
+#endif
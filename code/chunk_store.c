@@ -0,0 +1,85 @@
+/*
+  Read-only memory mapping of the master data file
+*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "chunk.h"
+#include "chunk_store.h"
+#include "log.h"
+
+static uint8_t *store_data; /* start of the mapping */
+static size_t store_size; /* length of the mapping in bytes */
+
+int chunk_store_open(char *filename) {
+    struct stat st;
+    void *addr;
+    int fd;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        LOG_ERROR("Failed to open data file %s.\n", filename);
+        return -1;
+    }
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        LOG_ERROR("Failed to stat data file %s.\n", filename);
+        close(fd);
+        return -1;
+    }
+
+    addr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    /* the mapping holds its own reference to the file */
+    close(fd);
+
+    if (addr == MAP_FAILED) {
+        LOG_ERROR("Failed to map data file %s.\n", filename);
+        return -1;
+    }
+
+    store_data = addr;
+    store_size = st.st_size;
+
+    LOG("Mapped %lu bytes of data file %s.\n",
+        (unsigned long) store_size, filename);
+    return 0;
+}
+
+uint8_t *chunk_store_data(unsigned id) {
+    size_t offset = (size_t) id * BT_CHUNK_SIZE;
+
+    /* a chunk past the end of the file would fault on access */
+    if (store_data == NULL || offset + BT_CHUNK_SIZE > store_size) {
+        return NULL;
+    }
+
+    return store_data + offset;
+}
+
+int chunk_store_map_chunk(chunk *c, int fd) {
+    void *addr;
+
+    addr = mmap(NULL, BT_CHUNK_SIZE, PROT_READ, MAP_SHARED, fd,
+                (off_t) c->id * BT_CHUNK_SIZE);
+
+    if (addr == MAP_FAILED) {
+        LOG_ERROR("Failed to map chunk (%u).\n", c->id);
+        return -1;
+    }
+
+    chunk_free_data(c);
+    c->chunk_data = addr;
+    c->data_type = CHUNK_DATA_MAPPED;
+    return 0;
+}
+
+void chunk_store_close(void) {
+    if (store_data != NULL) {
+        munmap(store_data, store_size);
+        store_data = NULL;
+        store_size = 0;
+    }
+}
@@ -0,0 +1,42 @@
+/*
+  The chunk store maps the master data file read-only.  The data of every
+  owned chunk is a slice into that mapping, so a seeder serves DATA straight
+  from the page cache instead of copying its whole data set onto the heap at
+  startup, and peers on the same host share the same pages.
+*/
+
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <inttypes.h>
+
+#include "chunk.h"
+
+/*
+  Map the data file read-only.
+
+  Returns 0 if successful, -1 otherwise.
+*/
+int chunk_store_open(char *filename);
+
+/*
+  Return a pointer to the data of the chunk with the given id inside the
+  mapping, or NULL if the chunk does not lie entirely inside the data file.
+*/
+uint8_t *chunk_store_data(unsigned id);
+
+/*
+  Replace the data of chunk c with a read-only mapping of the chunk at its
+  offset in the file fd, which must already hold the chunk's data.  The
+  file must not be truncated while the chunk is mapped from it.
+
+  Returns 0 if successful, -1 otherwise.
+*/
+int chunk_store_map_chunk(chunk *c, int fd);
+
+/*
+  Unmap the data file.
+*/
+void chunk_store_close(void);
+
+#endif
@@ -30,11 +30,6 @@ void congestion_control(Transfer *transfer) {
 }
 
 static void slow_start(Transfer *transfer) {
-    /* initialize the round trip time for later in congestion avoidance mode */
-    if ((transfer->cctrl).rtt == 0) {
-        (transfer->cctrl).rtt = millitime(NULL) - (transfer->timestamp);
-    }
-
     /* increment the window size if the window size is below ssthresh */
     if ((transfer->cctrl).wind_size < (transfer->cctrl).ssthresh) {
         (transfer->cctrl).wind_size *= 2;
@@ -45,45 +40,90 @@ static void slow_start(Transfer *transfer) {
     else {
         LOG("SSThresh reached, changed to CA.\n");
         (transfer->cctrl).congest_state = CA;
-        millitime(&((transfer->cctrl).rtt_timer));
+        nanotime(&((transfer->cctrl).rtt_timer));
         (transfer->cctrl).start_wind_size = (transfer->cctrl).wind_size;
     }
 }
 
-void detected_first_loss(Transfer *transfer) {
-    /* set ssthresh to max(windowsize/2, 2) before enter congestion */
-    /* avoidance mode */
+/*
+  The packets not yet delivered, whether in flight or lost.
+*/
+static unsigned flight_size(Transfer *transfer) {
+    Scoreboard *sb = (transfer->cctrl).board;
+
+    return sb->in_flight + sb->lost;
+}
+
+void fast_recovery_start(Transfer *transfer, unsigned dup_acks) {
+    (transfer->cctrl).ssthresh = MAX(flight_size(transfer) / 2, 2);
+    (transfer->cctrl).recover = (transfer->cctrl).board->high_sent;
+    (transfer->cctrl).inflation = dup_acks;
+    (transfer->cctrl).wind_size = (transfer->cctrl).ssthresh + dup_acks;
+    (transfer->cctrl).congest_state = FR;
+
+    graph_wind_size(transfer);
+    LOG("Switch to FR, ssthresh %d, recover (%u).\n",
+        (transfer->cctrl).ssthresh, (transfer->cctrl).recover);
+}
+
+void fast_recovery_dup_ack(Transfer *transfer) {
+    (transfer->cctrl).inflation++;
+    (transfer->cctrl).wind_size++;
+    graph_wind_size(transfer);
+}
 
-    (transfer->cctrl).ssthresh = MAX((transfer->cctrl).wind_size / 2, 2);
+int fast_recovery_ack(Transfer *transfer, uint32_t ack_num,
+                      unsigned newly_acked) {
+    /* full ACK: everything outstanding at the loss is acknowledged */
+    if (ack_num >= (transfer->cctrl).recover) {
+        (transfer->cctrl).inflation = 0;
+        (transfer->cctrl).wind_size = (transfer->cctrl).ssthresh;
 
-    if ((transfer->cctrl).congest_state == SS) {
-        LOG("Switch to CA.\n");
+        LOG("Recovered, switch to CA.\n");
         (transfer->cctrl).congest_state = CA;
-        millitime(&((transfer->cctrl).rtt_timer));
+        nanotime(&((transfer->cctrl).rtt_timer));
         (transfer->cctrl).start_wind_size = (transfer->cctrl).wind_size;
-    }
-    else {
-        (transfer->cctrl).wind_size = 1;
-        (transfer->cctrl).congest_state = SS;
 
         graph_wind_size(transfer);
-        LOG("Switch to SS, ssthresh %d.\n", (transfer->cctrl).ssthresh);
+        return 0;
+    }
+
+    /* partial ACK: the packets it acknowledges have left the network and
+       no longer need the inflation that stood for them */
+    if ((transfer->cctrl).inflation > newly_acked) {
+        (transfer->cctrl).inflation -= newly_acked;
+    } else {
+        (transfer->cctrl).inflation = 0;
     }
+
+    (transfer->cctrl).wind_size = (transfer->cctrl).ssthresh +
+                                  (transfer->cctrl).inflation;
+    return 1;
+}
+
+void detected_timeout(Transfer *transfer) {
+    (transfer->cctrl).ssthresh = MAX(flight_size(transfer) / 2, 2);
+    (transfer->cctrl).recover = (transfer->cctrl).board->high_sent;
+    (transfer->cctrl).inflation = 0;
+    (transfer->cctrl).wind_size = 1;
+    (transfer->cctrl).congest_state = SS;
+
+    graph_wind_size(transfer);
+    LOG("Timeout, window collapsed, ssthresh %d.\n",
+        (transfer->cctrl).ssthresh);
 }
 
 static void congestion_avoidance(Transfer *transfer) {
     /* increments the window size at most by one packet per RRT */
-    mytime_t new_wind_size;
+    nstime_t rtt = rtt_smoothed(&((transfer->cctrl).rtt), DEFAULT_RTT);
+    nstime_t new_wind_size;
 
-    if (((transfer->cctrl).rtt)) {
-        new_wind_size = ((millitime(NULL) - ((transfer->cctrl).rtt_timer))
-                         / ((transfer->cctrl).rtt))
-                        + (transfer->cctrl).start_wind_size;
+    new_wind_size = ((nanotime(NULL) - ((transfer->cctrl).rtt_timer)) / rtt)
+                    + (transfer->cctrl).start_wind_size;
 
-        if ((transfer->cctrl).wind_size != new_wind_size) {
-            (transfer->cctrl).wind_size = new_wind_size;
-            graph_wind_size(transfer);
-        }
+    if ((transfer->cctrl).wind_size != new_wind_size) {
+        (transfer->cctrl).wind_size = new_wind_size;
+        graph_wind_size(transfer);
     }
 }
 
@@ -4,7 +4,7 @@
   Handles congestion control:
   -- Slow Start
   -- Congestion Control
-  -- Fast Retransmit
+  -- Fast Retransmit and Fast Recovery, as in NewReno (RFC 6582)
 */
 
 #ifndef CONGESTION_H
@@ -17,14 +17,43 @@
 
 /*
   Check the transfer's congestion mode and switch between SS or CA mode.
+  The window does not grow in FR mode.
 */
 void congestion_control(Transfer *transfer);
 
 /*
-  Reset the sstthresh for the transfer after detecting a loss, and switch from
-  SS to CA mode or CA to SS mode.
+  Enter FR mode after detecting a loss: halve the window from the packets
+  in flight into ssthresh, inflated by the duplicate ACKs that have left
+  the network without SACKs, and remember the highest packet sent so that
+  recovery ends once it is acknowledged.
 */
-void detected_first_loss(Transfer *transfer);
+void fast_recovery_start(Transfer *transfer, unsigned dup_acks);
+
+/*
+  Inflate the window by one packet for a duplicate ACK in FR mode that
+  carried no SACKs.
+*/
+void fast_recovery_dup_ack(Transfer *transfer);
+
+/*
+  Handle an ACK of new data in FR mode, newly_acked packets past the
+  previous one.  A full ACK, covering every packet sent before the loss was
+  detected, deflates the window back to ssthresh and switches to CA mode.
+  A partial ACK takes back the inflation for the packets it acknowledges.
+
+  Returns 1 if the ACK was partial, in which case the packet after it is
+  lost too, 0 otherwise.
+*/
+int fast_recovery_ack(Transfer *transfer, uint32_t ack_num,
+                      unsigned newly_acked);
+
+/*
+  Collapse the transfer's window to one packet after a retransmission
+  timeout, halving ssthresh from the packets in flight, and restart in SS
+  mode, leaving FR mode if it was in it.  No fast recovery starts before
+  everything sent so far is acknowledged.
+*/
+void detected_timeout(Transfer *transfer);
 
 /*
   Records the peer id, time elapsed, and current congestion window size
@@ -0,0 +1,69 @@
+/*
+  Intrusive doubly linked list.  The links live inside the structures on the
+  list, so inserting and removing an element is O(1) and allocates nothing,
+  and the list keeps its size so counting is O(1) as well.  An element can be
+  on as many lists at once as it has links.
+*/
+
+#ifndef LIST_H
+#define LIST_H
+
+#include <stddef.h>
+
+typedef struct list_link {
+    struct list_link *prev, *next; /* both NULL when not on a list */
+} ListLink;
+
+typedef struct {
+    ListLink head; /* sentinel, head.next is the first element */
+    size_t size;
+} List;
+
+/* the structure of the given type containing the link as its member */
+#define list_entry(link, type, member) \
+    ((type *) ((char *) (link) - offsetof(type, member)))
+
+/* iterate the links of the list; the current link must not be removed */
+#define list_for_each(link, list) \
+    for ((link) = (list)->head.next; (link) != &((list)->head); \
+         (link) = (link)->next)
+
+/* iterate the links of the list; the current link may be removed */
+#define list_for_each_safe(link, tmp, list) \
+    for ((link) = (list)->head.next, (tmp) = (link)->next; \
+         (link) != &((list)->head); (link) = (tmp), (tmp) = (link)->next)
+
+static inline void list_init(List *list) {
+    list->head.prev = &(list->head);
+    list->head.next = &(list->head);
+    list->size = 0;
+}
+
+/* Returns 1 if the link is on a list, 0 otherwise. */
+static inline int list_linked(ListLink *link) {
+    return link->next != NULL;
+}
+
+static inline void list_push_back(List *list, ListLink *link) {
+    link->prev = list->head.prev;
+    link->next = &(list->head);
+    list->head.prev->next = link;
+    list->head.prev = link;
+    list->size++;
+}
+
+/* Remove the link from the list, which must be the list it is on. */
+static inline void list_remove(List *list, ListLink *link) {
+    link->prev->next = link->next;
+    link->next->prev = link->prev;
+    link->prev = NULL;
+    link->next = NULL;
+    list->size--;
+}
+
+/* Returns the link after the given one, NULL at the end of the list. */
+static inline ListLink *list_next(List *list, ListLink *link) {
+    return link->next == &(list->head) ? NULL : link->next;
+}
+
+#endif
@@ -1,5 +1,15 @@
 /*
   Utility for logging outputs
+
+  The ring is written by the thread running the peer and read by the drain
+  thread only, so it needs no lock: the writer owns ring_head and the drain
+  thread owns ring_tail, and each publishes its index to the other with
+  release/acquire ordering.  When the ring is full, records are dropped and
+  counted rather than making the peer wait.
+
+  The only waiting is in log_flush, which takes drain_lock to wake the drain
+  thread out of its sleep and to sleep until the drain thread reports the
+  ring drained, instead of spinning on ring_tail.
 */
 
 #include <stdlib.h>
@@ -7,53 +17,339 @@
 #include <string.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
 
 #include "bt_parse.h"
 #include "log.h"
 
 #define FILENAME_LEN 13
+#define LOG_WRITE_BUF_LEN (64 * 1024) /* bytes gathered per write */
+
+int log_level = LOG_LEVEL;
+
+static LogRecord ring[LOG_RING_RECORDS];
+static unsigned ring_head, ring_tail; /* records written / drained */
+static uint64_t dropped; /* records lost to a full ring */
+
+static LogSite *sites[LOG_MAX_SITES]; /* call sites by id; 0 is unused */
+static unsigned site_count = 1;
+
+static int log_fd = -1; /* records go to stderr as text until it is open */
+static int draining; /* whether the drain thread should keep going */
+static pthread_t drain_thread;
+
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t drain_wake; /* signaled to end the drain thread's sleep */
+static pthread_cond_t drained; /* broadcast after each pass of the drain */
+static int flush_wanted; /* a flush is waiting; under drain_lock */
+
+static uint8_t write_buf[LOG_WRITE_BUF_LEN]; /* used by the drain thread */
+static size_t write_len;
+
+static void *drain(void *arg);
+static void log_close(void);
+
+/*
+  Set up the conditions of the drain thread on the monotonic clock, which
+  their deadlines are read from.
+*/
+static void init_drain_conds(void) {
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&drain_wake, &attr);
+    pthread_cond_init(&drained, &attr);
+    pthread_condattr_destroy(&attr);
+}
 
-FILE *log_file;
+/*
+  Set *deadline to ms milliseconds from now on the monotonic clock.
+*/
+static void deadline_after(struct timespec *deadline, long ms) {
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    deadline->tv_sec += ms / 1000;
+    deadline->tv_nsec += (ms % 1000) * 1000000L;
+
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
 
 void setup_logging(bt_config_t *config) {
     char filename[FILENAME_LEN];
+    int fd;
 
     memset(filename, 0, FILENAME_LEN);
     sprintf(filename, "peer%d.log", config->identity);
 
-    log_file = fopen(filename, "w+");
+    if (config->log_level >= 0) {
+        log_level = config->log_level < LOG_LEVEL ?
+                    config->log_level : LOG_LEVEL;
+    }
 
-    if (log_file == NULL) {
-        LOG("Fail to open log file.\n");
-    } else {
-        LOG("I am peer (%d) @ %u\n\n",
-                   config->identity, config->myport);
+    fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd < 0) {
+        LOG_ERROR("Fail to open log file.\n");
+        return;
+    }
+
+    if (write(fd, LOG_FILE_MAGIC, LOG_FILE_MAGIC_LEN) != LOG_FILE_MAGIC_LEN) {
+        LOG_ERROR("Fail to write log file.\n");
+        close(fd);
+        return;
     }
+
+    log_fd = fd;
+    draining = 1;
+    init_drain_conds();
+
+    if (pthread_create(&drain_thread, NULL, drain, NULL) != 0) {
+        log_fd = -1;
+        draining = 0;
+        close(fd);
+        LOG_ERROR("Fail to start the log thread.\n");
+        return;
+    }
+
+    atexit(log_close);
+
+    LOG_INFO("I am peer (%d) @ %u\n\n", config->identity, config->myport);
 }
 
-void log_printf(const char *func, const int line, const char *format, ...) {
+/*
+  Give the site an id and work out how its arguments are stored.  A format
+  that records cannot hold is rendered at the call site instead.
+
+  Returns 0 if successful, -1 if there are too many sites.
+*/
+static int register_site(LogSite *site) {
+    if (site_count == LOG_MAX_SITES) {
+        return -1;
+    }
+
+    if (log_site_parse(site) < 0) {
+        site->preformatted = 1;
+        site->format = "%s";
+        site->nargs = 1;
+        site->types[0] = LOG_ARG_STRING;
+    }
+
+    /* the drain thread sees the site once a record of it is published */
+    sites[site_count] = site;
+    site->id = site_count++;
+    return 0;
+}
+
+/*
+  Write a call as text, with its prefix, to stderr.
+*/
+static void write_text(LogSite *site, const char *format, va_list args) {
+    if (site->func != NULL) {
+        fprintf(stderr, "[%s (%d)]\t", site->func, site->line);
+    }
+
+    vfprintf(stderr, format, args);
+}
+
+void log_write(LogSite *site, const char *format, ...) {
+    struct timespec ts;
+    LogRecord *rec;
+    unsigned head, tail;
+    char text[LOG_RECORD_ARGS_LEN];
     va_list args;
-    FILE *stream;
+
     va_start(args, format);
 
-    /* writes log to stderr if log_file is NULL, or else writes to log_file */
-    if (log_file == NULL) {
-        stream = stderr;
-    } else {
-        stream = log_file;
+    if (log_fd < 0 || (site->id == 0 && register_site(site) < 0)) {
+        write_text(site, format, args);
+        va_end(args);
+        return;
     }
 
-    if (func != NULL) {
-        fprintf(stream, "[%s (%d)]\t", func, line);
+    head = ring_head;
+    tail = __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail == LOG_RING_RECORDS) {
+        __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+        va_end(args);
+        return;
     }
 
-    /* writes to log file with optional arguments */
-    vfprintf(stream, format, args);
+    rec = &(ring[head & (LOG_RING_RECORDS - 1)]);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    rec->time = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->site = site->id;
+
+    if (site->preformatted) {
+        vsnprintf(text, sizeof(text), format, args);
+        rec->len = strlen(text) + 1;
+        memcpy(rec->args, text, rec->len);
+    } else {
+        log_record_pack(rec, site, args);
+    }
 
-    fflush(stream);
     va_end(args);
+
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+
+    /* errors are on disk before the call returns, in case the peer dies */
+    if (site->level == LOG_LEVEL_ERROR && site->func != NULL) {
+        log_flush();
+    }
+}
+
+void log_flush(void) {
+    unsigned head = ring_head;
+    struct timespec deadline;
+
+    if (log_fd < 0) {
+        return;
+    }
+
+    deadline_after(&deadline, LOG_FLUSH_TIMEOUT_MS);
+
+    pthread_mutex_lock(&drain_lock);
+    flush_wanted = 1;
+    pthread_cond_signal(&drain_wake);
+
+    /* the drain thread publishes ring_tail before taking the lock to
+       broadcast, so a pass that misses the check wakes the wait */
+    while ((int) (head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE)) > 0) {
+        if (pthread_cond_timedwait(&drained, &drain_lock, &deadline) ==
+            ETIMEDOUT) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&drain_lock);
+}
+
+/*
+  Stop the drain thread once it has written everything logged.
+*/
+static void log_close(void) {
+    if (log_fd < 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&drain_lock);
+    __atomic_store_n(&draining, 0, __ATOMIC_RELEASE);
+    pthread_cond_signal(&drain_wake);
+    pthread_mutex_unlock(&drain_lock);
+
+    pthread_join(drain_thread, NULL);
+
+    close(log_fd);
+    log_fd = -1;
+}
+
+/*
+  Write out what has been gathered in write_buf.
+*/
+static void write_out(void) {
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < write_len) {
+        if ((n = write(log_fd, write_buf + done, write_len - done)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break; /* nowhere left to report it */
+        }
+        done += n;
+    }
+
+    write_len = 0;
+}
+
+/*
+  Gather an entry into write_buf, writing out first if it does not fit.
+*/
+static void gather(uint16_t type, const void *payload, uint16_t len) {
+    LogEntryHeader header;
+
+    if (write_len + sizeof(header) + len > LOG_WRITE_BUF_LEN) {
+        write_out();
+    }
+
+    header.type = type;
+    header.len = len;
+    memcpy(write_buf + write_len, &header, sizeof(header));
+    memcpy(write_buf + write_len + sizeof(header), payload, len);
+    write_len += sizeof(header) + len;
+}
+
+static void gather_site(LogSite *site) {
+    size_t len;
+
+    if ((len = log_site_encode(write_buf + write_len,
+                               LOG_WRITE_BUF_LEN - write_len, site)) == 0) {
+        write_out();
+        len = log_site_encode(write_buf, LOG_WRITE_BUF_LEN, site);
+    }
+
+    write_len += len;
+    site->defined = 1;
+}
+
+static void *drain(void *arg) {
+    struct timespec deadline;
+    uint64_t reported = 0, lost;
+    unsigned head, tail = ring_tail;
+    LogRecord *rec;
+    int running;
+
+    do {
+        running = __atomic_load_n(&draining, __ATOMIC_ACQUIRE);
+        head = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE);
+
+        for (; tail != head; tail++) {
+            rec = &(ring[tail & (LOG_RING_RECORDS - 1)]);
+
+            /* a site is defined in the file before its first record */
+            if (!sites[rec->site]->defined) {
+                gather_site(sites[rec->site]);
+            }
+
+            gather(LOG_ENTRY_RECORD, rec, LOG_RECORD_HEADER_LEN + rec->len);
+        }
+
+        lost = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+        if (lost != reported) {
+            reported = lost;
+            gather(LOG_ENTRY_DROPPED, &reported, sizeof(reported));
+        }
+
+        write_out();
+
+        /* the records are copied out, the writer may reuse their slots */
+        __atomic_store_n(&ring_tail, tail, __ATOMIC_RELEASE);
+
+        pthread_mutex_lock(&drain_lock);
+        pthread_cond_broadcast(&drained);
+
+        /* sleep until the next interval, unless a flush came in during the
+           pass or wakes the thread before then */
+        if (running && !flush_wanted &&
+            __atomic_load_n(&draining, __ATOMIC_ACQUIRE)) {
+            deadline_after(&deadline, LOG_DRAIN_INTERVAL_MS);
+            pthread_cond_timedwait(&drain_wake, &drain_lock, &deadline);
+        }
+
+        flush_wanted = 0;
+        pthread_mutex_unlock(&drain_lock);
+    } while (running);
+
+    return arg;
 }
 
 void app_errno(char *msg) {
-    LOG("(%d) %s\n", msg, errno, strerror(errno));
+    LOG_ERROR("%s: (%d) %s\n", msg, errno, strerror(errno));
 }
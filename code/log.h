@@ -1,30 +1,135 @@
 /*
   Utility for logging outputs
+
+  Log calls are leveled.  Levels above LOG_LEVEL are compiled out entirely,
+  and levels above log_level are skipped at run time.  Per-packet call sites
+  use the _SAMPLED variants, which only log one call in n.
+
+  Once setup_logging has opened the log file, a log call only packs its
+  arguments into a binary record on an in-memory ring; a background thread
+  drains the ring into the log file, and log-decode renders the file as
+  text.  Before that, log calls are written to stderr as text.
+
+  LOG_ERROR is the exception: it blocks until its record is in the log file,
+  so that the error survives the peer dying right after it, for at most
+  LOG_FLUSH_TIMEOUT_MS.  Keep it off paths where errors are routine.
 */
 #ifndef LOG_H
 #define LOG_H
 
 #include "bt_parse.h"
+#include "log_record.h"
+
+#define LOG_LEVEL_NONE -1
+#define LOG_LEVEL_ERROR 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_DEBUG 2
+#define LOG_LEVEL_TRACE 3
 
+/* the most verbose level built in, chosen with -DLOG_LEVEL=<level> */
+#ifndef LOG_LEVEL
 #ifdef ENABLE_LOG
-#define LOG(...) \
-    do { log_printf(__func__, __LINE__, __VA_ARGS__); } while(0)
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_ERROR
+#endif
+#endif
+
+#define LOG_RING_RECORDS 8192 /* records buffered in memory; a power of two */
+#define LOG_DRAIN_INTERVAL_MS 10 /* how often the ring is drained */
+#define LOG_FLUSH_TIMEOUT_MS 100 /* the longest log_flush waits */
+
+/* the most verbose level logged at run time, at most LOG_LEVEL */
+extern int log_level;
+
+#define LOG_AT(level, format, ...) \
+    do { \
+        static LogSite log_site_ = { __func__, __LINE__, level, format }; \
+        if ((level) <= log_level) { \
+            log_write(&log_site_, format, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_SAMPLED_AT(level, n, format, ...) \
+    do { \
+        static LogSite log_site_ = { __func__, __LINE__, level, format }; \
+        static unsigned log_calls_; \
+        if ((level) <= log_level && log_calls_++ % (n) == 0) { \
+            log_write(&log_site_, format, ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+/* a disabled call still has its arguments checked against the format */
+#define LOG_NOTHING(...) \
+    do { if (0) log_discard(__VA_ARGS__); } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) LOG_NOTHING(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) LOG_NOTHING(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_DEBUG_SAMPLED(n, ...) \
+    LOG_SAMPLED_AT(LOG_LEVEL_DEBUG, n, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) LOG_NOTHING(__VA_ARGS__)
+#define LOG_DEBUG_SAMPLED(n, ...) LOG_NOTHING(__VA_ARGS__)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define LOG_TRACE_SAMPLED(n, ...) \
+    LOG_SAMPLED_AT(LOG_LEVEL_TRACE, n, __VA_ARGS__)
 #else
-#define LOG(...)
+#define LOG_TRACE(...) LOG_NOTHING(__VA_ARGS__)
+#define LOG_TRACE_SAMPLED(n, ...) LOG_NOTHING(__VA_ARGS__)
 #endif
 
-#define GRAPH(...) \
-    do { log_printf(NULL, 0, __VA_ARGS__); } while(0)
+/* per-packet call sites log one call in LOG_PACKET_SAMPLE */
+#define LOG_PACKET_SAMPLE 64
+
+/* the general purpose log call */
+#define LOG(...) LOG_DEBUG(__VA_ARGS__)
+
+/* output for graphing, without the [func (line)] prefix, at every level */
+#define GRAPH(format, ...) \
+    do { \
+        static LogSite log_site_ = { NULL, 0, LOG_LEVEL_ERROR, format }; \
+        log_write(&log_site_, format, ##__VA_ARGS__); \
+    } while (0)
 
 /*
-  Open the log file for reading
+  Open the log file for writing, start the thread that drains the log ring
+  into it, and apply the run time log level of the config.
 */
 void setup_logging(bt_config_t *config);
 
 /*
-  Output to log file similar to printf family of functions
+  Log a call of the site.  The format is the site's, passed again so that
+  the compiler checks the arguments against it.
 */
-void log_printf(const char *func, const int line, const char *format, ...);
+void log_write(LogSite *site, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+/*
+  Wake the drain thread and wait until every record logged so far has been
+  written to the log file, or LOG_FLUSH_TIMEOUT_MS has passed; the records
+  left are written later as usual.  Called by every LOG_ERROR.
+*/
+void log_flush(void);
+
+static inline void log_discard(const char *format, ...)
+    __attribute__((format(printf, 1, 2)));
+static inline void log_discard(const char *format, ...) {
+}
 
 /* help print errno code and message text */
 void app_errno(char *msg);
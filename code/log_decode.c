@@ -0,0 +1,152 @@
+/*
+  log-decode: render a binary peer log as text
+
+  usage: log-decode [-t] <peerN.log>
+
+  Each record is printed as it would have been logged, after its
+  [func (line)] prefix.  With -t every line is prefixed with the seconds
+  elapsed since the first record.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log_record.h"
+
+#define LOG_TEXT_LEN 1024
+
+static LogSite *sites[LOG_MAX_SITES];
+
+static void usage(char *prog) {
+    fprintf(stderr, "usage: %s [-t] <peer log file>\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+static int decode_site(uint8_t *payload, size_t len) {
+    LogSite *site;
+
+    /* the site and the strings it points to are kept in one block */
+    if ((site = malloc(sizeof(LogSite) + len)) == NULL) {
+        return -1;
+    }
+    memcpy(site + 1, payload, len);
+
+    if (log_site_decode(site, (uint8_t *) (site + 1), len) < 0 ||
+        site->id == 0 || site->id >= LOG_MAX_SITES) {
+        free(site);
+        return -1;
+    }
+
+    free(sites[site->id]);
+    sites[site->id] = site;
+    return 0;
+}
+
+static int decode_record(uint8_t *payload, size_t len, int timestamps,
+                         uint64_t *start) {
+    char text[LOG_TEXT_LEN];
+    LogRecord rec;
+    LogSite *site;
+
+    if (len < LOG_RECORD_HEADER_LEN || len > sizeof(rec)) {
+        return -1;
+    }
+
+    memset(&rec, 0, sizeof(rec));
+    memcpy(&rec, payload, len);
+
+    if (rec.site >= LOG_MAX_SITES || (site = sites[rec.site]) == NULL ||
+        rec.len != len - LOG_RECORD_HEADER_LEN) {
+        return -1;
+    }
+
+    if (*start == 0) {
+        *start = rec.time;
+    }
+
+    if (timestamps) {
+        printf("%12.6f ", (rec.time - *start) / 1e9);
+    }
+
+    if (site->func != NULL) {
+        printf("[%s (%d)]\t", site->func, site->line);
+    }
+
+    log_record_render(text, sizeof(text), site, &rec);
+    fputs(text, stdout);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    char magic[LOG_FILE_MAGIC_LEN];
+    uint8_t payload[UINT16_MAX];
+    LogEntryHeader header;
+    uint64_t start = 0, lost, reported = 0;
+    int c, timestamps = 0, ok = 0;
+    FILE *f;
+
+    while ((c = getopt(argc, argv, "t")) != -1) {
+        if (c == 't') {
+            timestamps = 1;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (optind != argc - 1) {
+        usage(argv[0]);
+    }
+
+    if ((f = fopen(argv[optind], "rb")) == NULL) {
+        perror(argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    if (fread(magic, 1, LOG_FILE_MAGIC_LEN, f) != LOG_FILE_MAGIC_LEN ||
+        memcmp(magic, LOG_FILE_MAGIC, LOG_FILE_MAGIC_LEN) != 0) {
+        fprintf(stderr, "%s: not a peer log file\n", argv[optind]);
+        fclose(f);
+        return EXIT_FAILURE;
+    }
+
+    while (fread(&header, sizeof(header), 1, f) == 1 &&
+           fread(payload, 1, header.len, f) == header.len) {
+        switch (header.type) {
+            case LOG_ENTRY_SITE:
+                ok = decode_site(payload, header.len);
+                break;
+
+            case LOG_ENTRY_RECORD:
+                ok = decode_record(payload, header.len, timestamps, &start);
+                break;
+
+            case LOG_ENTRY_DROPPED:
+                if (header.len != sizeof(lost)) {
+                    ok = -1;
+                    break;
+                }
+
+                /* the entry holds the total dropped so far */
+                memcpy(&lost, payload, sizeof(lost));
+                printf("[log dropped %llu records]\n",
+                       (unsigned long long) (lost - reported));
+                reported = lost;
+                ok = 0;
+                break;
+
+            default:
+                ok = -1;
+                break;
+        }
+
+        if (ok < 0) {
+            fprintf(stderr, "%s: corrupt entry\n", argv[optind]);
+            break;
+        }
+    }
+
+    fclose(f);
+    return ok < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,292 @@
+/*
+  Binary log records
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "log_record.h"
+
+#define LOG_SPEC_LEN 32 /* longest conversion specification rendered */
+#define LOG_SITE_FIXED_LEN 8 /* id, level and line of a site entry */
+
+/*
+  Find the end of the conversion specification starting at the '%' in spec,
+  and the type of the argument it takes.
+
+  Returns a pointer to the conversion character, or NULL if it is not
+  supported.
+*/
+static const char *parse_spec(const char *spec, char *type) {
+    const char *p = spec + 1;
+    char length = 0;
+
+    /* flags, width and precision */
+    while (*p != '\0' && strchr("-+ #0123456789.", *p) != NULL) {
+        p++;
+    }
+
+    /* length modifier */
+    if (*p == 'h') {
+        p += (p[1] == 'h') ? 2 : 1;
+    } else if (*p == 'l') {
+        length = (p[1] == 'l') ? 'q' : 'l';
+        p += (p[1] == 'l') ? 2 : 1;
+    } else if (*p == 'z' || *p == 't') {
+        length = 'z';
+        p++;
+    } else if (*p == 'j') {
+        length = 'j';
+        p++;
+    }
+
+    switch (*p) {
+        case 'd': case 'i': case 'u': case 'x': case 'X': case 'o':
+            *type = length ? length : LOG_ARG_INT;
+            return p;
+        case 'c':
+            *type = LOG_ARG_INT;
+            return p;
+        case 'e': case 'E': case 'f': case 'F': case 'g': case 'G':
+        case 'a': case 'A':
+            *type = LOG_ARG_DOUBLE;
+            return length ? NULL : p; /* no long double */
+        case 's':
+            *type = LOG_ARG_STRING;
+            return length ? NULL : p; /* no wide strings */
+        case 'p':
+            *type = LOG_ARG_POINTER;
+            return p;
+        default:
+            return NULL;
+    }
+}
+
+int log_site_parse(LogSite *site) {
+    const char *p;
+    char type;
+
+    site->nargs = 0;
+
+    for (p = site->format; *p != '\0'; p++) {
+        if (*p != '%') {
+            continue;
+        }
+
+        if (p[1] == '%') {
+            p++;
+            continue;
+        }
+
+        if ((p = parse_spec(p, &type)) == NULL ||
+            site->nargs == LOG_MAX_ARGS) {
+            return -1;
+        }
+
+        site->types[site->nargs++] = type;
+    }
+
+    return 0;
+}
+
+void log_record_pack(LogRecord *rec, const LogSite *site, va_list args) {
+    uint8_t *p = rec->args, *end = rec->args + LOG_RECORD_ARGS_LEN;
+    const char *s;
+    uint64_t value;
+    double d;
+    size_t len;
+    int i;
+
+    for (i = 0; i < site->nargs; i++) {
+        switch (site->types[i]) {
+            case LOG_ARG_INT:
+                value = (uint64_t) va_arg(args, int);
+                break;
+            case LOG_ARG_LONG:
+                value = (uint64_t) va_arg(args, long);
+                break;
+            case LOG_ARG_LLONG:
+                value = (uint64_t) va_arg(args, long long);
+                break;
+            case LOG_ARG_SIZE:
+                value = (uint64_t) va_arg(args, size_t);
+                break;
+            case LOG_ARG_INTMAX:
+                value = (uint64_t) va_arg(args, intmax_t);
+                break;
+            case LOG_ARG_POINTER:
+                value = (uint64_t) (uintptr_t) va_arg(args, void *);
+                break;
+            case LOG_ARG_DOUBLE:
+                d = va_arg(args, double);
+                memcpy(&value, &d, sizeof(value));
+                break;
+            case LOG_ARG_STRING:
+            default:
+                if ((s = va_arg(args, const char *)) == NULL) {
+                    s = "(null)";
+                }
+
+                /* strings are cut short to what is left of the record */
+                if (p == end) {
+                    goto full;
+                }
+                len = strnlen(s, end - p - 1);
+                memcpy(p, s, len);
+                p[len] = '\0';
+                p += len + 1;
+                continue;
+        }
+
+        if (end - p < (long) sizeof(value)) {
+            goto full;
+        }
+        memcpy(p, &value, sizeof(value));
+        p += sizeof(value);
+    }
+
+full:
+    rec->len = p - rec->args;
+}
+
+/*
+  Render one argument with its conversion specification.
+*/
+static int render_arg(char *buf, size_t size, const char *spec, char type,
+                      const uint8_t **arg, const uint8_t *end) {
+    uint64_t value;
+    double d;
+    const char *s;
+
+    if (type == LOG_ARG_STRING) {
+        if (*arg >= end) {
+            return snprintf(buf, size, "<truncated>");
+        }
+
+        s = (const char *) *arg;
+        *arg += strnlen(s, end - *arg) + 1;
+        return snprintf(buf, size, spec, s);
+    }
+
+    if (end - *arg < (long) sizeof(value)) {
+        return snprintf(buf, size, "<truncated>");
+    }
+
+    memcpy(&value, *arg, sizeof(value));
+    *arg += sizeof(value);
+
+    switch (type) {
+        case LOG_ARG_LONG:
+            return snprintf(buf, size, spec, (long) value);
+        case LOG_ARG_LLONG:
+            return snprintf(buf, size, spec, (long long) value);
+        case LOG_ARG_SIZE:
+            return snprintf(buf, size, spec, (size_t) value);
+        case LOG_ARG_INTMAX:
+            return snprintf(buf, size, spec, (intmax_t) value);
+        case LOG_ARG_POINTER:
+            return snprintf(buf, size, spec, (void *) (uintptr_t) value);
+        case LOG_ARG_DOUBLE:
+            memcpy(&d, &value, sizeof(d));
+            return snprintf(buf, size, spec, d);
+        case LOG_ARG_INT:
+        default:
+            return snprintf(buf, size, spec, (int) value);
+    }
+}
+
+size_t log_record_render(char *buf, size_t size, const LogSite *site,
+                         const LogRecord *rec) {
+    const uint8_t *arg = rec->args, *end = rec->args + rec->len;
+    char spec[LOG_SPEC_LEN];
+    const char *p, *conv;
+    size_t pos = 0, len;
+    char type;
+    int i = 0, n;
+
+    if (size == 0) {
+        return 0;
+    }
+
+    for (p = site->format; *p != '\0' && pos + 1 < size; p++) {
+        if (*p != '%' || p[1] == '%') {
+            buf[pos++] = *p;
+            p += (*p == '%');
+            continue;
+        }
+
+        if ((conv = parse_spec(p, &type)) == NULL || i == site->nargs ||
+            (len = conv - p + 1) >= LOG_SPEC_LEN) {
+            break;
+        }
+
+        memcpy(spec, p, len);
+        spec[len] = '\0';
+
+        n = render_arg(buf + pos, size - pos, spec, site->types[i++], &arg,
+                       end);
+        if (n > 0) {
+            pos += ((size_t) n < size - pos) ? (size_t) n : size - pos - 1;
+        }
+
+        p = conv;
+    }
+
+    buf[pos] = '\0';
+    return pos;
+}
+
+size_t log_site_encode(uint8_t *buf, size_t size, const LogSite *site) {
+    LogEntryHeader header;
+    const char *func = site->func ? site->func : "";
+    size_t func_len = strlen(func) + 1, format_len = strlen(site->format) + 1;
+    uint16_t id = site->id, level = site->level;
+    uint32_t line = site->line;
+
+    header.type = LOG_ENTRY_SITE;
+    header.len = LOG_SITE_FIXED_LEN + func_len + format_len;
+
+    if (sizeof(header) + header.len > size) {
+        return 0;
+    }
+
+    memcpy(buf, &header, sizeof(header));
+    buf += sizeof(header);
+    memcpy(buf, &id, sizeof(id));
+    memcpy(buf + 2, &level, sizeof(level));
+    memcpy(buf + 4, &line, sizeof(line));
+    memcpy(buf + LOG_SITE_FIXED_LEN, func, func_len);
+    memcpy(buf + LOG_SITE_FIXED_LEN + func_len, site->format, format_len);
+
+    return sizeof(header) + header.len;
+}
+
+int log_site_decode(LogSite *site, uint8_t *payload, size_t len) {
+    uint16_t id, level;
+    uint32_t line;
+    char *func, *format;
+
+    if (len < LOG_SITE_FIXED_LEN + 2 || payload[len - 1] != '\0') {
+        return -1;
+    }
+
+    memcpy(&id, payload, sizeof(id));
+    memcpy(&level, payload + 2, sizeof(level));
+    memcpy(&line, payload + 4, sizeof(line));
+
+    func = (char *) payload + LOG_SITE_FIXED_LEN;
+    format = func + strlen(func) + 1;
+
+    if ((uint8_t *) format >= payload + len) {
+        return -1;
+    }
+
+    memset(site, 0, sizeof(LogSite));
+    site->id = id;
+    site->level = level;
+    site->line = line;
+    site->func = (*func != '\0') ? func : NULL;
+    site->format = format;
+
+    return log_site_parse(site);
+}
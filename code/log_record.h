@@ -0,0 +1,118 @@
+/*
+  Binary log records.
+
+  A log call is captured as a fixed-size record holding the time, the id of
+  its call site and its arguments packed as binary values.  The format, the
+  function and the line are kept once in the call site, so no text is
+  formatted when a record is made; the text is rendered afterwards from the
+  record and its call site, by log-decode.
+
+  A log file starts with LOG_FILE_MAGIC and is followed by entries, each a
+  LogEntryHeader and its payload:
+  -- LOG_ENTRY_SITE: the definition of a call site, written before the
+     first record of the site
+  -- LOG_ENTRY_RECORD: the used part of a LogRecord
+  -- LOG_ENTRY_DROPPED: the total number of records lost to a full ring
+     so far, as a uint64_t
+*/
+
+#ifndef LOG_RECORD_H
+#define LOG_RECORD_H
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+#define LOG_FILE_MAGIC "BTLOG01\n"
+#define LOG_FILE_MAGIC_LEN 8
+
+#define LOG_RECORD_SIZE 128
+#define LOG_RECORD_HEADER_LEN 16
+#define LOG_RECORD_ARGS_LEN (LOG_RECORD_SIZE - LOG_RECORD_HEADER_LEN)
+#define LOG_MAX_ARGS 12 /* conversions in one format */
+#define LOG_MAX_SITES 1024 /* call sites in one program */
+
+/* how an argument is passed and stored */
+enum log_arg_type {
+    LOG_ARG_INT = 'i', /* int and everything promoted to it */
+    LOG_ARG_LONG = 'l', /* long */
+    LOG_ARG_LLONG = 'q', /* long long */
+    LOG_ARG_SIZE = 'z', /* size_t and ptrdiff_t */
+    LOG_ARG_INTMAX = 'j', /* intmax_t */
+    LOG_ARG_DOUBLE = 'f', /* double */
+    LOG_ARG_STRING = 's', /* a string, copied into the record */
+    LOG_ARG_POINTER = 'p' /* a pointer */
+};
+
+/* The static description of one log call site */
+typedef struct {
+    const char *func; /* NULL for output without the [func (line)] prefix */
+    int line;
+    int level;
+    const char *format;
+    uint16_t id; /* 0 until the site is first used */
+    uint8_t nargs;
+    uint8_t preformatted; /* the format is not supported, the record holds
+                             the rendered text as one string */
+    char types[LOG_MAX_ARGS]; /* an enum log_arg_type per argument */
+    int defined; /* the definition has been written to the log file */
+} LogSite;
+
+typedef struct {
+    uint64_t time; /* nanoseconds on the monotonic clock */
+    uint16_t site; /* id of the call site */
+    uint16_t len; /* bytes of args in use */
+    uint32_t reserved;
+    uint8_t args[LOG_RECORD_ARGS_LEN];
+} LogRecord;
+
+enum log_entry_type {
+    LOG_ENTRY_SITE = 1,
+    LOG_ENTRY_RECORD = 2,
+    LOG_ENTRY_DROPPED = 3
+};
+
+typedef struct {
+    uint16_t type; /* enum log_entry_type */
+    uint16_t len; /* bytes of payload following the header */
+} LogEntryHeader;
+
+/*
+  Work out the number and types of the arguments of the site's format.
+
+  Returns 0 if successful, -1 if the format holds a conversion that cannot
+  be stored in a record (such as a '*' width).
+*/
+int log_site_parse(LogSite *site);
+
+/*
+  Pack the arguments described by the site into the record.  Strings are
+  truncated, and arguments dropped, once the record is full.
+*/
+void log_record_pack(LogRecord *rec, const LogSite *site, va_list args);
+
+/*
+  Render the message of the record as text into buf, which always ends up
+  NUL terminated.
+
+  Returns the length of the text.
+*/
+size_t log_record_render(char *buf, size_t size, const LogSite *site,
+                         const LogRecord *rec);
+
+/*
+  Encode the site definition entry, header included, into buf.
+
+  Returns the length of the entry, or 0 if it does not fit.
+*/
+size_t log_site_encode(uint8_t *buf, size_t size, const LogSite *site);
+
+/*
+  Decode the payload of a site definition entry into site.  The function
+  and format strings point into payload, which must outlive the site.
+
+  Returns 0 if successful, -1 if the payload is malformed.
+*/
+int log_site_decode(LogSite *site, uint8_t *payload, size_t len);
+
+#endif
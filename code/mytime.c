@@ -1,11 +1,30 @@
 #include "mytime.h"
 
-mytime_t millitime(mytime_t *time) {
-    struct timeval tv;
-    mytime_t nCount;
+static nstime_t now; /* the cached time, 0 until the clock is first read */
+
+nstime_t mytime_update(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (nstime_t) ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+
+    return now;
+}
+
+nstime_t nanotime(nstime_t *time) {
+    if (now == 0) {
+        mytime_update();
+    }
 
-    gettimeofday(&tv, NULL);
-    nCount = (mytime_t) (tv.tv_usec/1000 + (tv.tv_sec & 0xfffff) * 1000);
+    if (time != NULL) {
+        *time = now;
+    }
+
+    return now;
+}
+
+mytime_t millitime(mytime_t *time) {
+    mytime_t nCount = (mytime_t) (nanotime(NULL) / NSEC_PER_MSEC);
 
     if (time != NULL) {
         *time = nCount;
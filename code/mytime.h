@@ -1,14 +1,38 @@
 #ifndef MYTIME_H
 #define MYTIME_H
 
-#include <sys/time.h>
-#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
 
-/* return the time since epoch in milliseconds:
-   Code reference: https://code.google.com/p/lz4/issues/attachmentText?id=39&aid=390001000&name=gettimeofday.patch&token=NCIqhNChcHl0ht7Qtbu8reNw0jA%3A1383498967479
- */
-typedef unsigned long mytime_t;
+/*
+  Time is read from CLOCK_MONOTONIC, which never jumps with the wall clock,
+  and cached: the event loop refreshes the cached time once per iteration
+  with mytime_update, and everything handled in that iteration reads the
+  same "now" for free.
+*/
+typedef unsigned long mytime_t; /* milliseconds */
+typedef uint64_t nstime_t; /* nanoseconds */
 
-mytime_t millitime(mytime_t *);
+#define NSEC_PER_MSEC 1000000ULL
+#define NSEC_PER_SEC 1000000000ULL
+
+/*
+  Read the monotonic clock into the cached time.
+
+  Returns the new cached time in nanoseconds.
+*/
+nstime_t mytime_update(void);
+
+/*
+  Return the cached monotonic time in nanoseconds, reading the clock first
+  if it has never been read, and store it in *time if time is not NULL.
+*/
+nstime_t nanotime(nstime_t *time);
+
+/*
+  Return the cached monotonic time in milliseconds, and store it in *time if
+  time is not NULL.
+*/
+mytime_t millitime(mytime_t *time);
 
 #endif
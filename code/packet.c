@@ -1,7 +1,10 @@
+#define _GNU_SOURCE /* for sendmmsg */
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
 
 #include "log.h"
 #include "packet.h"
@@ -12,9 +15,36 @@
 #define BYTE_SIZE_2 2
 #define BYTE_SIZE_4 4
 
+/* Header of a DATA packet; packet_len and seq_num are patched in per packet */
+static const uint8_t data_header[STANDARD_HEADER_LEN] = {
+    MAGIC_NUM >> 8, MAGIC_NUM & 0xff, /* magic number */
+    VER_NUM, /* version number */
+    DATA, /* packet type */
+    0, STANDARD_HEADER_LEN, /* header length */
+    0, 0, /* packet length */
+    0, 0, 0, 0, /* sequence number */
+    0, 0, 0, 0 /* acknowledgment number */
+};
+
+/* Header of an ACK packet; packet_len and ack_num are patched in per
+   packet */
+static const uint8_t ack_header[STANDARD_HEADER_LEN] = {
+    MAGIC_NUM >> 8, MAGIC_NUM & 0xff, /* magic number */
+    VER_NUM, /* version number */
+    ACK, /* packet type */
+    0, STANDARD_HEADER_LEN, /* header length */
+    0, STANDARD_HEADER_LEN, /* packet length */
+    0, 0, 0, 0, /* sequence number */
+    0, 0, 0, 0 /* acknowledgment number */
+};
+
+PacketCounter packet_rx[PACKET_TYPE_COUNT + 1];
+PacketCounter packet_tx[PACKET_TYPE_COUNT];
+
 /* Static Function Declarations */
 static void serialize_payload(Packet *p, uint8_t *buffer);
-static void deserialize_payload(Packet *p, uint8_t *buf);
+static void send_iov_to_peer(int sock, struct iovec *iov, size_t iovcnt,
+                             bt_peer_t *p);
 
 /*
   return string presentation of the packet type.  Used mostly for debug purposes
@@ -38,21 +68,146 @@ const char *packet_type_str(enum packet_type t) {
     }
 }
 
+/*
+  Send one packet gathered from iovcnt iovecs to peer p.  Through spiffy the
+  header is prepended as one more iovec, so the packet is never copied.
+*/
+static void send_iov_to_peer(int sock, struct iovec *iov, size_t iovcnt,
+                             bt_peer_t *p) {
+    struct msghdr msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = &(p->addr);
+    msg.msg_namelen = sizeof(p->addr);
+    msg.msg_iov = iov;
+    msg.msg_iovlen = iovcnt;
+
+    spiffy_sendmsg(sock, &msg, 0);
+}
+
 void send_packet_to_peer(int sock, Packet* pack, bt_peer_t* p) {
     uint8_t* packet = serialize_packet(pack);
+    struct iovec iov;
+
     if (packet == NULL) {
         return;
     }
 
-    spiffy_sendto(sock, packet, pack->packet_len, 0,
-                   (struct sockaddr *) &(p->addr), sizeof(p->addr));
+    iov.iov_base = packet;
+    iov.iov_len = pack->packet_len;
+    send_iov_to_peer(sock, &iov, 1, p);
+    packet_count(&(packet_tx[pack->type]), pack->packet_len);
 
     free(packet);
     return;
 }
 
+void send_ack_to_peer(int sock, bt_peer_t *p, uint32_t ack_num,
+                      const uint8_t *sack, uint16_t sack_len) {
+    uint8_t header[STANDARD_HEADER_LEN];
+    struct iovec iov[2];
+    uint16_t packet_len;
+
+    if (sack_len > SACK_MAX_LEN) {
+        sack_len = SACK_MAX_LEN;
+    }
+
+    memcpy(header, ack_header, STANDARD_HEADER_LEN);
+    packet_len = htons(STANDARD_HEADER_LEN + sack_len);
+    memcpy(header + 6, &packet_len, BYTE_SIZE_2);
+    ack_num = htonl(ack_num);
+    memcpy(header + 12, &ack_num, BYTE_SIZE_4);
+
+    /* the SACK bitmap is sent from where the caller built it */
+    iov[0].iov_base = header;
+    iov[0].iov_len = STANDARD_HEADER_LEN;
+    iov[1].iov_base = (void *) sack;
+    iov[1].iov_len = sack_len;
+
+    send_iov_to_peer(sock, iov, sack_len ? 2 : 1, p);
+    packet_count(&(packet_tx[ACK]), STANDARD_HEADER_LEN + sack_len);
+}
+
+void send_data_to_peer(int sock, bt_peer_t *p, DataSegment *segs,
+                       unsigned count) {
+    uint8_t headers[MAX_DATA_BURST][STANDARD_HEADER_LEN];
+    struct iovec iov[MAX_DATA_BURST][2];
+    struct mmsghdr msgs[MAX_DATA_BURST];
+    uint16_t packet_len;
+    uint32_t seq_num;
+    unsigned i, n, sent;
+    int ret;
+
+    while (count > 0) {
+        n = count < MAX_DATA_BURST ? count : MAX_DATA_BURST;
+        memset(msgs, 0, n * sizeof(struct mmsghdr));
+
+        for (i = 0; i < n; i++) {
+            packet_len = htons(STANDARD_HEADER_LEN + segs[i].data_len);
+            seq_num = htonl(segs[i].seq_num);
+
+            memcpy(headers[i], data_header, STANDARD_HEADER_LEN);
+            memcpy(headers[i] + 6, &packet_len, BYTE_SIZE_2);
+            memcpy(headers[i] + 8, &seq_num, BYTE_SIZE_4);
+
+            /* the payload goes out straight from the chunk data */
+            iov[i][0].iov_base = headers[i];
+            iov[i][0].iov_len = STANDARD_HEADER_LEN;
+            iov[i][1].iov_base = segs[i].data;
+            iov[i][1].iov_len = segs[i].data_len;
+
+            msgs[i].msg_hdr.msg_name = &(p->addr);
+            msgs[i].msg_hdr.msg_namelen = sizeof(p->addr);
+            msgs[i].msg_hdr.msg_iov = iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 2;
+        }
+
+        /* sendmmsg may stop short, keep going with the rest of the burst */
+        for (sent = 0; sent < n; sent += ret) {
+            ret = spiffy_sendmmsg(sock, msgs + sent, n - sent, 0);
+
+            if (ret <= 0) {
+                LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE,
+                                  "Failed to send DATA burst to peer (%u).\n",
+                                  p->id);
+                return;
+            }
+        }
+
+        for (i = 0; i < n; i++) {
+            packet_count(&(packet_tx[DATA]),
+                         STANDARD_HEADER_LEN + segs[i].data_len);
+        }
+
+        segs += n;
+        count -= n;
+    }
+}
+
+void packet_log_counters(void) {
+    int t;
+
+    for (t = 0; t < PACKET_TYPE_COUNT; t++) {
+        LOG("%s: received %" PRIu64 " packets (%" PRIu64 " bytes), "
+            "sent %" PRIu64 " packets (%" PRIu64 " bytes)\n",
+            packet_type_str(t), packet_rx[t].packets, packet_rx[t].bytes,
+            packet_tx[t].packets, packet_tx[t].bytes);
+    }
+
+    LOG("invalid: received %" PRIu64 " packets (%" PRIu64 " bytes)\n",
+        packet_rx[PACKET_INVALID].packets, packet_rx[PACKET_INVALID].bytes);
+}
+
 void send_packet_to_all(int sock, Packet* pack, bt_config_t *config) {
     uint8_t* packet = serialize_packet(pack);
+    struct iovec iov;
+
+    if (packet == NULL) {
+        return;
+    }
+
+    iov.iov_base = packet;
+    iov.iov_len = pack->packet_len;
 
     /* send the packet to all peers */
     bt_peer_t* p;
@@ -62,8 +217,8 @@ void send_packet_to_all(int sock, Packet* pack, bt_config_t *config) {
         if (config->identity != p->id) {
             /* start the timer for the peer */
             millitime(&(p->timer));
-            spiffy_sendto(sock, packet, pack->packet_len, 0,
-                       (struct sockaddr *) &(p->addr), sizeof(p->addr));
+            send_iov_to_peer(sock, &iov, 1, p);
+            packet_count(&(packet_tx[pack->type]), pack->packet_len);
         }
     }
 
@@ -71,100 +226,103 @@ void send_packet_to_all(int sock, Packet* pack, bt_config_t *config) {
     return;
 }
 
-Packet* deserialize_packet(uint8_t* buf) {
-    uint8_t version;
+int packet_view_init(PacketView *v, uint8_t *buf, size_t len) {
+    uint8_t *start = buf;
     uint16_t magic, header_len, packet_len;
-    uint32_t seq_num, ack_num;
-    uint8_t* start_buf;
-    Packet *p;
+    size_t payload_len;
 
-    start_buf = buf;
+    if (len < STANDARD_HEADER_LEN) {
+        return -1;
+    }
 
     memcpy(&magic, buf, BYTE_SIZE_2);
-    buf += BYTE_SIZE_2;
 
     /* the first two bytes could be the extension ID field */
     if (ntohs(magic) != MAGIC_NUM) {
+        buf += BYTE_SIZE_2;
 
         /* if there is extension, check if the next magic number matches */
+        if (len < STANDARD_HEADER_LEN + BYTE_SIZE_2) {
+            return -1;
+        }
         memcpy(&magic, buf, BYTE_SIZE_2);
-        buf += BYTE_SIZE_2;
 
         /* makes sure the packet has the correct magic number, if */
         /* it doesn't drop the packet */
         if (ntohs(magic) != MAGIC_NUM) {
-            return NULL;
+            return -1;
         }
     }
 
-    memcpy(&version, buf, BYTE_SIZE_1);
-    buf += BYTE_SIZE_1;
-
     /* makes sure the packet has the correct version number, if */
     /* it doesn't drop the packet */
-    if (version != VER_NUM) {
-        return NULL;
+    if (buf[2] != VER_NUM) {
+        return -1;
     }
 
-    /* parse the header and stores info into the packet structure */
-    p = (Packet*) calloc(1, sizeof(Packet));
+    memcpy(&header_len, buf + 4, BYTE_SIZE_2);
+    memcpy(&packet_len, buf + 6, BYTE_SIZE_2);
+    header_len = ntohs(header_len);
+    packet_len = ntohs(packet_len);
 
-    if (p == NULL) {
-        app_errno("Failed to calloc Packet for deserialize.\n");
-        return NULL;
+    /* the lengths must agree with what was actually received */
+    if (header_len < STANDARD_HEADER_LEN || header_len > packet_len ||
+        packet_len > len) {
+        return -1;
     }
 
-    /* type of packet: DATA, GET, WHOHAS, etc.*/
-    p->type = *buf;
-    buf += BYTE_SIZE_1;
-
-    memcpy(&header_len, buf, BYTE_SIZE_2);
-    buf += BYTE_SIZE_2;
-    p->header_len = ntohs(header_len);
-
-    memcpy(&packet_len, buf, BYTE_SIZE_2);
-    buf += BYTE_SIZE_2;
-    p->packet_len = ntohs(packet_len);
+    v->header = buf;
+    v->payload = start + header_len;
+    v->type = buf[3];
+    v->header_len = header_len;
+    v->packet_len = packet_len;
+    v->hash_num = 0;
 
-    memcpy(&seq_num, buf, BYTE_SIZE_4);
-    buf += BYTE_SIZE_4;
-    p->seq_num = ntohl(seq_num);
+    payload_len = packet_len - header_len;
 
-    memcpy(&ack_num, buf, BYTE_SIZE_4);
-    buf += BYTE_SIZE_4;
-    p->ack_num = ntohl(ack_num);
+    if (v->type == WHOHAS || v->type == IHAVE || v->type == GET ||
+        v->type == DENIED) {
+        /* a hash count and 3 bytes of padding, then the hashes */
+        if (payload_len >= HEADER_PAD_LEN) {
+            v->hash_num = v->payload[0];
+        }
 
-    deserialize_payload(p, start_buf + (p->header_len));
+        if (v->hash_num > MAX_HASH_IN_PACKET ||
+            (v->hash_num > 0 &&
+             HEADER_PAD_LEN + v->hash_num * BIN_HASH_SIZE > payload_len)) {
+            return -1;
+        }
+    }
+    else if (v->type == DATA && payload_len > DATA_SIZE) {
+        return -1;
+    }
 
-    return p;
+    return 0;
 }
 
-/*
-  parse the payload and stores info into the packet structure
-*/
-static void deserialize_payload(Packet *p, uint8_t *buf) {
-    int i;
-
-    if (p->type == WHOHAS || p->type == IHAVE || p->type == GET ||
-        p->type == DENIED) {
-        /* WHOHAS and IHAVE contains no data */
-        p->hash_num = *buf;
-        buf += BYTE_SIZE_4; /* padding of 3 */
+int packet_peek_data_header(uint8_t *header, uint32_t *seq_num,
+                            uint16_t *data_len) {
+    uint16_t magic, header_len, packet_len;
 
-        /* load the hashes from the payload */
-        for (i = 0; i < p->hash_num; i++) {
-            memcpy(p->hash_list[i], buf, BIN_HASH_SIZE * BYTE_SIZE_1);
-            buf += (BIN_HASH_SIZE * BYTE_SIZE_1);
-        }
-    }
-    else if (p->type == ACK) {
-        return;
-    }
-    else {
-        /* DATA packets' payload just contain the data */
-        p->hash_num = 0;
-        memcpy(p->data, buf, (p->packet_len - p->header_len));
+    memcpy(&magic, header, BYTE_SIZE_2);
+    memcpy(&header_len, header + 4, BYTE_SIZE_2);
+    memcpy(&packet_len, header + 6, BYTE_SIZE_2);
+    memcpy(seq_num, header + 8, BYTE_SIZE_4);
+
+    header_len = ntohs(header_len);
+    packet_len = ntohs(packet_len);
+    *seq_num = ntohl(*seq_num);
+
+    /* anything unusual is left to packet_view_init */
+    if (ntohs(magic) != MAGIC_NUM || header[2] != VER_NUM ||
+        header[3] != DATA || header_len != STANDARD_HEADER_LEN ||
+        packet_len < header_len ||
+        packet_len - header_len > DATA_SIZE) {
+        return -1;
     }
+
+    *data_len = packet_len - header_len;
+    return 0;
 }
 
 uint8_t* serialize_packet(Packet* p) {
@@ -175,7 +333,7 @@ uint8_t* serialize_packet(Packet* p) {
     packet = calloc(p->packet_len, BYTE_SIZE_1);
 
     if (packet == NULL) {
-        LOG("Failed to calloc Packet to serialize.\n");
+        LOG_ERROR("Failed to calloc Packet to serialize.\n");
         return NULL;
     }
 
@@ -249,12 +407,5 @@ static void serialize_payload(Packet *p, uint8_t *buffer) {
             buffer += (BIN_HASH_SIZE * BYTE_SIZE_1);
         }
     }
-    else if (p->type == ACK) {
-        return;
-    }
-    else {
-        /* DATA packets' payload just contain the data */
-        /* load the data into the payload */
-        memcpy(buffer, p->data, (p->packet_len - p->header_len));
-    }
+    /* ACK packets carry no payload, and DATA is sent by send_data_to_peer */
 }
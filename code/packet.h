@@ -3,8 +3,9 @@
 
 #include <inttypes.h>
 #include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
 #include "hash.h"
-#include "linkedlist.h"
 #include "bt_parse.h"
 #include "chunk.h"
 
@@ -16,6 +17,8 @@
 #define HEADER_PAD_LEN 4
 #define MAX_PAYLOAD_SIZE (MAX_PACKET_SIZE - STANDARD_HEADER_LEN - HEADER_PAD_LEN)
 #define MAX_HASH_IN_PACKET (MAX_PAYLOAD_SIZE / BIN_HASH_SIZE)
+#define MAX_DATA_BURST 64 /* max DATA packets handed to one sendmmsg call */
+#define SACK_MAX_LEN 64 /* bytes of SACK bitmap in an ACK, 8 packets each */
 
 enum packet_type {
     WHOHAS,
@@ -26,8 +29,30 @@ enum packet_type {
     DENIED
 };
 
+#define PACKET_TYPE_COUNT (DENIED + 1)
+#define PACKET_INVALID PACKET_TYPE_COUNT /* counter slot of bad packets */
+
+/* Number of packets and bytes of one packet type */
+typedef struct {
+    uint64_t packets;
+    uint64_t bytes;
+} PacketCounter;
+
+/* received packets by type, with malformed or unknown ones at
+   PACKET_INVALID, and sent packets by type */
+extern PacketCounter packet_rx[PACKET_TYPE_COUNT + 1];
+extern PacketCounter packet_tx[PACKET_TYPE_COUNT];
+
 const char *packet_type_str(enum packet_type t);
 
+/* One DATA packet of a burst, its payload is read in place from data */
+typedef struct {
+    uint32_t seq_num;
+    uint8_t *data;
+    uint16_t data_len;
+} DataSegment;
+
+/* A packet to be serialized and sent; DATA is sent with send_data_to_peer */
 typedef struct Packet {
     enum packet_type type;
     uint16_t header_len;
@@ -36,27 +61,163 @@ typedef struct Packet {
     uint32_t ack_num;
     uint8_t hash_num;
     uint8_t hash_list[MAX_HASH_IN_PACKET][BIN_HASH_SIZE];
-    uint8_t data[DATA_SIZE];
 } Packet;
 
+/*
+  A read-only view of a received packet.  The header is validated in place by
+  packet_view_init, and the accessors below read the fields, the hash list and
+  the payload straight out of the receive buffer.
+*/
+typedef struct {
+    uint8_t *header; /* the magic number, past any extension ID */
+    uint8_t *payload; /* header_len bytes into the packet */
+    uint8_t type;
+    uint16_t header_len;
+    uint16_t packet_len;
+    uint8_t hash_num; /* 0 unless the type carries a hash list */
+} PacketView;
+
+/*
+  Validate the header of the len bytes received in buf and aim the view at
+  them.
+
+  \return
+  if successful: 0
+  else: -1 if buf does not hold a well formed packet
+*/
+int packet_view_init(PacketView *v, uint8_t *buf, size_t len);
+
+/*
+  Check whether the STANDARD_HEADER_LEN bytes in header start a DATA packet
+  with a standard header, and if so read its sequence number and payload
+  length.  Used to peek at a datagram before receiving it.
+
+  \return
+  if successful: 0
+  else: -1
+*/
+int packet_peek_data_header(uint8_t *header, uint32_t *seq_num,
+                            uint16_t *data_len);
+
+/*
+  Aim the view at a DATA or ACK packet with a standard header.  Only what
+  those two types need is checked: the first six header bytes against the
+  fixed magic, version and header length, and the packet length.  Anything
+  else, extension headers included, is left to packet_view_init.
+
+  \return
+  if successful: DATA or ACK
+  else: -1
+*/
+static inline int packet_view_init_fast(PacketView *v, uint8_t *buf,
+                                        size_t len) {
+    uint16_t packet_len;
+
+    if (len < STANDARD_HEADER_LEN ||
+        buf[0] != (MAGIC_NUM >> 8) || buf[1] != (MAGIC_NUM & 0xff) ||
+        buf[2] != VER_NUM || (buf[3] != DATA && buf[3] != ACK) ||
+        buf[4] != 0 || buf[5] != STANDARD_HEADER_LEN) {
+        return -1;
+    }
+
+    packet_len = (buf[6] << 8) | buf[7];
+
+    if (packet_len < STANDARD_HEADER_LEN || packet_len > len ||
+        packet_len - STANDARD_HEADER_LEN > DATA_SIZE) {
+        return -1;
+    }
+
+    v->header = buf;
+    v->payload = buf + STANDARD_HEADER_LEN;
+    v->type = buf[3];
+    v->header_len = STANDARD_HEADER_LEN;
+    v->packet_len = packet_len;
+    v->hash_num = 0;
+
+    return v->type;
+}
+
+/* count a packet of len bytes in a counter of packet_rx or packet_tx */
+static inline void packet_count(PacketCounter *counter, size_t len) {
+    counter->packets++;
+    counter->bytes += len;
+}
+
+/*
+  Log the received and sent packet counters.
+*/
+void packet_log_counters(void);
+
+static inline uint32_t packet_view_seq_num(PacketView *v) {
+    uint32_t seq_num;
+    memcpy(&seq_num, v->header + 8, sizeof(seq_num));
+    return ntohl(seq_num);
+}
+
+static inline uint32_t packet_view_ack_num(PacketView *v) {
+    uint32_t ack_num;
+    memcpy(&ack_num, v->header + 12, sizeof(ack_num));
+    return ntohl(ack_num);
+}
+
+/* number of hashes in a WHOHAS, IHAVE, GET or DENIED packet */
+static inline uint8_t packet_view_hash_num(PacketView *v) {
+    return v->hash_num;
+}
+
+/* the ith binary hash of the hash list, after the 3 bytes of padding */
+static inline uint8_t *packet_view_hash(PacketView *v, int i) {
+    return v->payload + HEADER_PAD_LEN + i * BIN_HASH_SIZE;
+}
+
+/*
+  The SACK bitmap carried as the payload of an ACK packet.  Bit i (bit i % 8
+  of byte i / 8) is set if the packet ack_num + 1 + i has been received.
+  ACKs without a payload carry no selective acknowledgements.
+*/
+static inline uint8_t *packet_view_sack(PacketView *v) {
+    return v->payload;
+}
+
+static inline uint16_t packet_view_sack_len(PacketView *v) {
+    return v->packet_len - v->header_len;
+}
+
+/* the payload of a DATA packet */
+static inline uint8_t *packet_view_data(PacketView *v) {
+    return v->payload;
+}
+
+static inline uint16_t packet_view_data_len(PacketView *v) {
+    return v->packet_len - v->header_len;
+}
+
 /*
   Send a packet to one peer
 */
 void send_packet_to_peer(int sock, Packet* pack, bt_peer_t* p);
 
 /*
-  Send a packet to all peers
+  Send a burst of DATA packets to a peer with one sendmmsg call per
+  MAX_DATA_BURST packets.  Each payload is sent in place from its data
+  pointer, behind a header copied from a pre-built template, so it is never
+  copied in user space.
 */
-void send_packet_to_all(int sock, Packet* pack, bt_config_t *config);
+void send_data_to_peer(int sock, bt_peer_t *p, DataSegment *segs,
+                       unsigned count);
 
 /*
-  Convert from a binary array to a packet struct
+  Send an ACK packet to a peer, with sack_len bytes of SACK bitmap, at most
+  SACK_MAX_LEN, as its payload.  The header is copied from a pre-built
+  template with only the lengths and the acknowledgment number patched in.
+*/
+void send_ack_to_peer(int sock, bt_peer_t *p, uint32_t ack_num,
+                      const uint8_t *sack, uint16_t sack_len);
 
-  \returns
-  if successful: a pointer to a dynamically allcoated Packet struct
-  else: NULL
+/*
+  Send a packet to all peers
 */
-Packet* deserialize_packet(uint8_t* buf);
+void send_packet_to_all(int sock, Packet* pack, bt_config_t *config);
 
 /*
   Convert from the packet struct to binary array that can be sent over the
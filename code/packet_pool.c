@@ -0,0 +1,56 @@
+/*
+  A fixed-capacity pool of receive buffers
+*/
+
+#include <assert.h>
+
+#include "packet_pool.h"
+#include "log.h"
+
+static uint8_t pool[PACKET_POOL_SIZE][MAX_PACKET_SIZE];
+static uint8_t *free_list[PACKET_POOL_SIZE]; /* stack of unused buffers */
+static unsigned free_count = PACKET_POOL_SIZE;
+static unsigned peak; /* high water mark of buffers in use */
+static int initialized;
+
+uint8_t *packet_pool_get(void) {
+    unsigned i;
+
+    /* every buffer starts out on the free list */
+    if (!initialized) {
+        for (i = 0; i < PACKET_POOL_SIZE; i++) {
+            free_list[i] = pool[i];
+        }
+        initialized = 1;
+    }
+
+    if (free_count == 0) {
+        LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE, "Packet pool exhausted.\n");
+        return NULL;
+    }
+
+    if (packet_pool_in_use() + 1 > peak) {
+        peak = packet_pool_in_use() + 1;
+    }
+
+    return free_list[--free_count];
+}
+
+void packet_pool_put(uint8_t *buf) {
+    if (buf == NULL) {
+        return;
+    }
+
+    assert(buf >= pool[0] && buf < pool[0] + sizeof(pool));
+    assert(free_count < PACKET_POOL_SIZE);
+
+    free_list[free_count++] = buf;
+}
+
+unsigned packet_pool_in_use(void) {
+    return PACKET_POOL_SIZE - free_count;
+}
+
+unsigned packet_pool_peak(void) {
+    return peak;
+}
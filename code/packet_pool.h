@@ -0,0 +1,42 @@
+/*
+  A fixed-capacity pool of receive buffers.
+
+  Datagrams are received into buffers taken from the pool, read in place
+  through a PacketView, and the buffers are given back once the packets have
+  been dispatched, so steady state receiving makes no heap allocations.
+*/
+
+#ifndef PACKET_POOL_H
+#define PACKET_POOL_H
+
+#include <inttypes.h>
+
+#include "packet.h"
+
+#define PACKET_POOL_SIZE 64 /* one buffer per datagram of a receive batch */
+
+/*
+  Take a buffer of MAX_PACKET_SIZE bytes from the pool.
+
+  \return
+  if successful: a buffer that must be given back with packet_pool_put
+  else: NULL if every buffer is in use
+*/
+uint8_t *packet_pool_get(void);
+
+/*
+  Give a buffer back to the pool.
+*/
+void packet_pool_put(uint8_t *buf);
+
+/*
+  Return the number of buffers currently taken from the pool.
+*/
+unsigned packet_pool_in_use(void);
+
+/*
+  Return the highest number of buffers ever taken from the pool at once.
+*/
+unsigned packet_pool_peak(void);
+
+#endif
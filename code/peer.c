@@ -8,6 +8,7 @@
   HingOn Miu <hmiu@andrew>
 */
 
+#define _GNU_SOURCE /* for recvmmsg */
 #include <sys/time.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
@@ -17,28 +18,52 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
 
 #include "debug.h"
 #include "spiffy.h"
 #include "bt_parse.h"
 #include "input_buffer.h"
-#include "linkedlist.h"
 #include "chunk.h"
+#include "chunk_store.h"
 #include "bt_io.h"
 #include "log.h"
 #include "packet.h"
+#include "packet_pool.h"
 #include "hash.h"
 #include "transfer.h"
 #include "bt_server.h"
 #include "bt_client.h"
+#include "reactor.h"
+#include "timer_wheel.h"
 #include "peer.h"
 
+#define RECV_BATCH PACKET_POOL_SIZE /* max datagrams drained per wakeup */
+#define RECV_BATCH_MIN 4 /* datagrams posted to an idle socket */
+
+/* ring of receive buffers for recvmmsg, filled from the packet pool */
+static unsigned recv_batch = RECV_BATCH_MIN; /* buffers posted per recvmmsg */
+static uint8_t *recv_bufs[RECV_BATCH];
+static struct sockaddr_in recv_addrs[RECV_BATCH];
+static struct iovec recv_iovs[RECV_BATCH];
+static struct mmsghdr recv_msgs[RECV_BATCH];
+
+#define TIMER_TICK_MS 5000 /* period of the WHOHAS and new transfer checks */
+
+static struct user_iobuf *userbuf; /* partial lines typed by the user */
+
 /* Static Functions */
 static void peer_run(bt_config_t *config);
 static void peer_setup(bt_config_t *config);
 static void load_own_chunk_data(bt_config_t *config);
 static void handle_user_input(bt_config_t *config, char *line, void *cbdata);
 static void handle_timeout(bt_config_t *config);
+static void on_socket_ready(int fd, uint32_t events, void *arg);
+static void on_stdin_ready(int fd, uint32_t events, void *arg);
+static void on_timer(int fd, uint32_t events, void *arg);
 
 int main(int argc, char **argv) {
     bt_config_t config;
@@ -72,45 +97,76 @@ int main(int argc, char **argv) {
     return 0;
 }
 
-/**
- * Returns 1 if two peer addresses are equal, 0 otherwise.
- */
-int compare_peer_addr(struct sockaddr_in *p1_addr, struct sockaddr_in *p2_addr){
-    return ((ntohs(p1_addr->sin_port) == ntohs(p2_addr->sin_port)) &&
-            (strcmp(inet_ntoa(p1_addr->sin_addr),
-                    inet_ntoa(p2_addr->sin_addr)) == 0));
-}
-
 /**
  * Find the peer of all peers with matching address.
  */
 bt_peer_t* find_peer(bt_config_t *config, struct sockaddr_in *p_addr) {
-    bt_peer_t* p;
+    return bt_peer_by_addr(config, p_addr);
+}
 
-    for (p = config->peers; p != NULL; p = p->next) {
-        if (compare_peer_addr(&(p->addr), p_addr) == 1) {
-            return p;
-        }
-    }
+/*
+  Handlers of the packet types, called with a validated view of the packet
+  and the peer it came from.
+*/
+typedef void (*packet_handler)(PacketView *packet, bt_peer_t *peer,
+                               bt_config_t *config);
 
-    return NULL;
+/* Server Side */
+static void on_WHOHAS(PacketView *packet, bt_peer_t *peer,
+                      bt_config_t *config) {
+    receive_WHOHAS(packet, peer);
 }
 
-void process_inbound_udp(int sock, bt_config_t *config) {
-#define BUFLEN 1500
-    struct sockaddr_in from;
-    socklen_t fromlen;
-    char buf[BUFLEN];
-    Packet* packet;
-    bt_peer_t* peer;
+static void on_GET(PacketView *packet, bt_peer_t *peer, bt_config_t *config) {
+    receive_GET(packet, peer, config->max_conn);
+}
+
+static void on_ACK(PacketView *packet, bt_peer_t *peer, bt_config_t *config) {
+    receive_ACK(packet, peer);
+}
 
-    fromlen = sizeof(from);
-    spiffy_recvfrom(sock, buf, BUFLEN, 0, (struct sockaddr *) &from, &fromlen);
+/* Client Side */
+static void on_IHAVE(PacketView *packet, bt_peer_t *peer,
+                     bt_config_t *config) {
+    receive_IHAVE(packet, peer, config);
+}
+
+static void on_DENIED(PacketView *packet, bt_peer_t *peer,
+                      bt_config_t *config) {
+    receive_DENIED(packet, peer);
+}
 
-    peer = find_peer(config, &from);
+static void on_DATA(PacketView *packet, bt_peer_t *peer,
+                    bt_config_t *config) {
+    receive_DATA(packet, peer, config);
+}
+
+static const packet_handler handlers[PACKET_TYPE_COUNT] = {
+    [WHOHAS] = on_WHOHAS,
+    [IHAVE] = on_IHAVE,
+    [GET] = on_GET,
+    [DATA] = on_DATA,
+    [ACK] = on_ACK,
+    [DENIED] = on_DENIED
+};
+
+/**
+ * Handle one datagram of a receive batch.  DATA and ACK with a standard
+ * header are recognized by packet_view_init_fast and handled directly; all
+ * other packets are decoded in full and go through the handler table.
+ */
+static void process_datagram(uint8_t *buf, size_t len,
+                             struct sockaddr_in *from, bt_config_t *config) {
+    PacketView view;
+    PacketView *packet = &view;
+    bt_peer_t* peer;
+    int type;
+
+    peer = find_peer(config, from);
 
     if (peer == NULL) {
-        LOG("Invalid Peer - NULL.\n");
+        LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE, "Invalid Peer - NULL.\n");
+        packet_count(&(packet_rx[PACKET_INVALID]), len);
         return;
     }
 
@@ -118,66 +174,119 @@ void process_inbound_udp(int sock, bt_config_t *config) {
     peer->timer = millitime(NULL);
     peer->timeout_count = 0;
 
-    /* parse the buf and store info to Packet struct */
-    packet = deserialize_packet((uint8_t *)buf);
+    type = packet_view_init_fast(packet, buf, len);
+
+    if (type == DATA) {
+        packet_count(&(packet_rx[DATA]), len);
+        receive_DATA(packet, peer, config);
+        return;
+    }
+
+    if (type == ACK) {
+        packet_count(&(packet_rx[ACK]), len);
+        receive_ACK(packet, peer);
+        return;
+    }
 
-    if (packet == NULL) {
-        LOG("Invalid Packet - NULL.\n");
+    /* validate the header in place; the handlers read from buf */
+    if (packet_view_init(packet, buf, len) < 0 ||
+        packet->type >= PACKET_TYPE_COUNT) {
+        LOG_DEBUG_SAMPLED(LOG_PACKET_SAMPLE, "Invalid Packet from peer (%u).\n",
+                          peer->id);
+        packet_count(&(packet_rx[PACKET_INVALID]), len);
         return;
     }
 
-    if (packet != NULL && peer != NULL) {
-        switch(packet->type) {
-            /* Server Side */
-            case WHOHAS:
-                receive_WHOHAS(packet, peer);
-                break;
-
-            case GET:
-                receive_GET(packet, peer, config->max_conn);
-                break;
-
-            case ACK:
-                receive_ACK(packet, peer);
-                break;
-
-                /* Client Side */
-            case IHAVE:
-                receive_IHAVE(packet, config, &from);
-                break;
-
-            case DENIED:
-                receive_DENIED(packet, config, &from);
-                break;
-
-            case DATA:
-                receive_DATA(packet, peer, config);
-                break;
-
-            default:
-                LOG("INVALID packet type received\n");
-                assert(0);
-                break;
+    packet_count(&(packet_rx[packet->type]), len);
+    handlers[packet->type](packet, peer, config);
+}
+
+/**
+ * Drain up to RECV_BATCH datagrams from the socket with one recvmmsg call and
+ * dispatch them.  ACKs and DATA owed by the batch are sent once at the end.
+ * Returns the number of datagrams consumed, 0 once the socket is empty.
+ *
+ * Only recv_batch buffers are taken from the pool for the call, and the
+ * ones left unfilled go straight back.  The batch doubles while recvmmsg
+ * fills it and halves when it comes back mostly empty, so the pool is only
+ * drawn down as far as the traffic needs.
+ */
+int process_inbound_udp(int sock, bt_config_t *config) {
+    int i, count, nbufs, direct;
+
+    /* DATA of a download in progress is received straight into its chunk */
+    for (direct = 0; direct < RECV_BATCH; direct++) {
+        if (receive_DATA_direct(sock, config) != 1) {
+            break;
         }
     }
 
-    return;
+    for (nbufs = 0; nbufs < (int) recv_batch; nbufs++) {
+        if ((recv_bufs[nbufs] = packet_pool_get()) == NULL) {
+            break;
+        }
+    }
+
+    for (i = 0; i < nbufs; i++) {
+        recv_iovs[i].iov_base = recv_bufs[i];
+        recv_iovs[i].iov_len = MAX_PACKET_SIZE;
+
+        memset(&(recv_msgs[i].msg_hdr), 0, sizeof(struct msghdr));
+        recv_msgs[i].msg_hdr.msg_name = &(recv_addrs[i]);
+        recv_msgs[i].msg_hdr.msg_namelen = sizeof(recv_addrs[i]);
+        recv_msgs[i].msg_hdr.msg_iov = &(recv_iovs[i]);
+        recv_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    count = spiffy_recvmmsg(sock, recv_msgs, nbufs, MSG_DONTWAIT, NULL);
+
+    if (count < 0) {
+        count = 0;
+    }
+
+    /* buffers nothing was received into are not held during dispatch */
+    for (i = count; i < nbufs; i++) {
+        packet_pool_put(recv_bufs[i]);
+    }
+
+    if (count > 0 && count == nbufs && recv_batch < RECV_BATCH) {
+        recv_batch *= 2;
+    } else if (count < nbufs / 4 && recv_batch > RECV_BATCH_MIN) {
+        recv_batch /= 2;
+    }
+
+    for (i = 0; i < count; i++) {
+        process_datagram(recv_bufs[i], recv_msgs[i].msg_len,
+                         &(recv_addrs[i]), config);
+    }
+
+    /* the rest go back to the pool once the batch has been dispatched */
+    for (i = 0; i < count; i++) {
+        packet_pool_put(recv_bufs[i]);
+    }
+
+    /* ACK generation and window updates are amortized over the batch */
+    send_pending_ACKs();
+    send_pending_DATA();
+
+    return direct + count;
 }
 
 /*
   Create the wanted list and missing list.
 
-  The wanted list is all the chunks requested by the user.  The missing list is
-  the list of chunks fo wanted - have.
+  The wanted list is all the chunks requested by the user, each once, with
+  the output ids it was requested at recorded on the chunk.  The missing list
+  is the list of chunks fo wanted - have.
 
   This reads in the chunks file specified by the user.
 */
 void create_wanted_missing_list(char *chunkfile) {
     FILE *f;
-    Node *node;
     chunk* c;
-    int id;
-    char line[FILE_LEN], hash[HEX_HASH_SIZE];
+    int id, owned;
+    char line[FILE_LEN], hash[HEX_HASH_SIZE + 1];
+    uint8_t bin_hash[BIN_HASH_SIZE];
 
     /* open the getchunkfile */
     f = fopen(chunkfile, "r");
@@ -188,32 +297,48 @@ void create_wanted_missing_list(char *chunkfile) {
         sscanf(line, "%d %s\n", &id, hash);
         LOG("Want chunk (%u:%s)\n", id, (char *) hash);
 
-        node = node_find(have, compare_chunk_by_hex_wrapper, hash);
-        if (node == NULL) {
+        hex2binary(hash, HEX_HASH_SIZE, bin_hash);
+        c = chunk_set_find(&have_set, bin_hash);
+        owned = (c != NULL);
+
+        if (c == NULL && (c = chunk_set_find(&missing_set, bin_hash))) {
+            /* the same chunk listed twice is downloaded once */
+            LOG("Chunk (%s) is already missing\n", chunk_hex_hash(c));
+        }
+        else if (c == NULL) {
             c = create_chunk(id, (uint8_t *) hash);
-            node = node_insert(&(missing), c);
+            assert(c != NULL);
+            list_push_back(&missing, &(c->link));
+            chunk_set_insert(&missing_set, c);
 
             LOG("inserted chunk with hash "
                        "(%s) in missing\n",
-                       (char *) c->hex_hash);
+                       chunk_hex_hash(c));
 
-            LOG("missing now has %d chunks\n",
-                       count_node(&missing));
+            LOG("missing now has %zu chunks\n", missing_set.count);
         } else {
-            LOG("Do have chunk id %u\n",
-                       ((chunk*) (node->data))->id);
+            LOG("Do have chunk id %u\n", c->id);
         }
 
-        c = node->data;
-        c->id = id;
+        /* c->id stays where the data lives; the output ids are kept apart so
+           that a chunk listed twice is written at both places */
+        if (chunk_add_output(c, id) == EXIT_FAILURE) {
+            continue;
+        }
+
+        /* a chunk listed again is already wanted, at its new id as well */
+        if (c->output_count == 1) {
+            vector_push(&wanted, c);
+        }
+
+        /* an owned chunk can go straight to the output file */
+        if (owned) {
+            write_chunk_to_output(c, id);
+        }
 
-        node_insert(&(wanted), node->data);
         LOG("inserted chunk (%u) with hash (%s)"
-                   " in wanted\n",
-                   ((chunk*) (node->data))->id,
-                   (char *) ((chunk*)(node->data))->hex_hash);
-        LOG("wanted now has %d chunks\n",
-                   count_node(&wanted));
+                   " in wanted\n", id, chunk_hex_hash(c));
+        LOG("wanted now has %u chunks\n", wanted.size);
     }
 
     check_all_received();
@@ -225,6 +350,24 @@ void process_get(char *chunkfile, char *outputfile, bt_config_t *config) {
     user_output_filename = outputfile;
     user_get_chunk_file = chunkfile;
 
+    /* Chunks an earlier GET wrote to this path are still mapped from it, and
+       truncating the file would leave those mappings past its end.  The old
+       file is unlinked instead (the mappings keep it alive) and a new one is
+       created; if it cannot be unlinked, the GET is refused. */
+    if (unlink(outputfile) < 0 && errno != ENOENT) {
+        LOG_ERROR("Failed to replace output file (%s).\n", outputfile);
+    }
+
+    /* chunks are written to the output file as soon as they are verified */
+    user_output_fd = open(outputfile, O_RDWR | O_CREAT | O_EXCL, 0644);
+
+    if (user_output_fd < 0) {
+        LOG_ERROR("Failed to open output file (%s).\n", outputfile);
+        free(user_output_filename);
+        free(user_get_chunk_file);
+        return;
+    }
+
     /* check to see what chunks the user wants for output file */
     create_wanted_missing_list(chunkfile);
 
@@ -237,11 +380,27 @@ void process_get(char *chunkfile, char *outputfile, bt_config_t *config) {
   the actual data chunks that map to chunks indicated in .haschunkfile
 */
 static void peer_setup(bt_config_t *config) {
+    ListLink *link;
+
     LOG("peer_setup begin.\n");
 
+    list_init(&have);
+    list_init(&missing);
+    vector_init(&wanted);
+
     /* create the have chunk list with the given haschunk file */
     parse_chunkfile(&(have), config->has_chunk_file);
 
+    /* index the have and missing sets by binary hash */
+    if (chunk_set_init(&have_set) < 0 || chunk_set_init(&missing_set) < 0 ||
+        client_init() < 0 || server_init() < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    list_for_each(link, &have) {
+        chunk_set_insert(&have_set, list_entry(link, chunk, link));
+    }
+
     /* load the have chunk data from masterchunk file */
     load_own_chunk_data(config);
 
@@ -250,12 +409,12 @@ static void peer_setup(bt_config_t *config) {
 }
 
 /*
-  Read the master chunk file and extract the data chunk owned by self
+  Read the master chunk file and map the data chunks owned by self
 */
 static void load_own_chunk_data(bt_config_t *config) {
     FILE* masterchunkfile_f;
     char line[FILE_LEN], master_chunk_filename[PATH_LEN];
-    Node* node;
+    ListLink *link;
     chunk *c;
 
     LOG("get own chunk data from master.\n");
@@ -268,24 +427,32 @@ static void load_own_chunk_data(bt_config_t *config) {
         /* parse the data file location from the master chunk file */
         sscanf(line, "File: %s\n", master_chunk_filename);
 
-        /* read the have list and load each chunk data */
-        for (node = have; node != NULL; node = node->next) {
-            c = node->data;
-            read_chunk_data_file_by_id(master_chunk_filename,
-                                       c->id, c->chunk_data);
+        /* map the data file so owned chunks are read from the page cache */
+        chunk_store_open(master_chunk_filename);
+
+        /* point each chunk in the have list at its data */
+        list_for_each(link, &have) {
+            c = list_entry(link, chunk, link);
+
+            if ((c->chunk_data = chunk_store_data(c->id)) != NULL) {
+                c->data_type = CHUNK_DATA_STORE;
+            }
+            else if (chunk_alloc_data(c) == EXIT_SUCCESS) {
+                /* a short or unmappable chunk is copied onto the heap */
+                read_chunk_data_file_by_id(master_chunk_filename,
+                                           c->id, c->chunk_data);
+            }
 
             LOG("Loaded chunk %d with hash %s\n",
-                       c->id, (char *)c->hex_hash);
-            c->bits_count = MAX_SEQ_NUM;
+                       c->id, chunk_hex_hash(c));
         }
     }
+
+    fclose(masterchunkfile_f);
 }
 
 static void peer_run(bt_config_t *config) {
     struct sockaddr_in myaddr;
-    fd_set readfds;
-    struct user_iobuf *userbuf;
-    struct timeval tv; /* timeouts for select */
 
     if ((userbuf = create_userbuf()) == NULL) {
         perror("peer_run could not allocate userbuf");
@@ -309,36 +476,56 @@ static void peer_run(bt_config_t *config) {
 
     spiffy_init(config->identity, (struct sockaddr *)&myaddr, sizeof(myaddr));
 
-    while (1) {
-        int nfds;
-        FD_SET(STDIN_FILENO, &readfds);
-        FD_SET(sock, &readfds);
+    timer_wheel_init(millitime(NULL));
 
-        /* timeout for select */
-        tv.tv_sec = 5; //TIMEOUT_THRESHOLD;
-        tv.tv_usec = 0;
+    if (reactor_init() < 0 ||
+        reactor_add(sock, EPOLLIN | EPOLLET, on_socket_ready, config) < 0 ||
+        reactor_add_timer(TIMER_TICK_MS, on_timer, config) < 0) {
+        perror("peer_run could not set up the event loop");
+        exit(-1);
+    }
 
-        nfds = select(sock+1, &readfds, NULL, NULL, &tv);
+    /* stdin may be a file or /dev/null, which epoll cannot watch */
+    if (reactor_add(STDIN_FILENO, EPOLLIN, on_stdin_ready, config) < 0) {
+        LOG("User input is not available.\n");
+    }
 
-        if (nfds > 0) {
-            if (FD_ISSET(sock, &readfds)) {
-                process_inbound_udp(sock, config);
-            }
+    reactor_run();
+}
 
-            if (FD_ISSET(STDIN_FILENO, &readfds)) {
-                process_user_input(config, STDIN_FILENO, userbuf,
-                                   handle_user_input, "Currently unused");
-            }
-        } else if (nfds == 0) {
-            /* if select time-outed, handle timeout of client and server side */
-            handle_timeout(config);
-        }
+/*
+  The socket is edge triggered, so it is drained until it is empty.
+*/
+static void on_socket_ready(int fd, uint32_t events, void *arg) {
+    events = events; /* quiet GCC compilation */
+
+    /* a busy socket can keep this going for long, so the cached time is
+       refreshed for each receive batch */
+    while (process_inbound_udp(fd, arg) > 0) {
+        mytime_update();
+    }
+}
+
+static void on_stdin_ready(int fd, uint32_t events, void *arg) {
+    if (events & EPOLLIN) {
+        process_user_input(arg, fd, userbuf, handle_user_input,
+                           "Currently unused");
+    }
+    else if (events & (EPOLLHUP | EPOLLERR)) {
+        /* the user closed stdin, nothing more will come */
+        reactor_del(fd);
     }
 }
 
+static void on_timer(int fd, uint32_t events, void *arg) {
+    fd = fd; /* quiet GCC compilation */
+    events = events;
+
+    handle_timeout(arg);
+}
+
 /*********** Helper Functions ***********/
 static void handle_timeout(bt_config_t *config) {
-    handle_server_timeout(config);
     handle_client_timeout(config);
 }
 
@@ -353,11 +540,3 @@ static void handle_user_input(bt_config_t *config, char *line, void *cbdata) {
         }
     }
 }
-
-int compare_chunk_by_hex_wrapper(const void *c, const void *hash) {
-    return compare_chunk_by_hex_hash((chunk *) c, (char *) hash);
-}
-
-int compare_chunk_by_bin_wrapper(const void *c, const void *hash) {
-    return compare_chunk_by_bin_hash((chunk *) c, (uint8_t *) hash);
-}
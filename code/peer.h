@@ -6,29 +6,26 @@
 */
 #include <sys/time.h>
 
-#include "linkedlist.h"
+#include "list.h"
+#include "vector.h"
 #include "bt_parse.h"
+#include "chunk_set.h"
 
 mytime_t start_time;
 
-Node *wanted; /* a linked list of chunk of user requested */
-Node *have; /* a linked list of chunk locally owned */
-Node *missing; /* wanted - have */
+/* The chunks requested by the user, each once.  Whether a requested hash is
+   owned or still missing is answered by have_set and missing_set, and the
+   output ids are on the chunks, so wanted is never searched: it is only
+   walked once the GET completes, and needs no index. */
+Vector wanted;
+List have; /* the chunks locally owned, linked by chunk.link */
+List missing; /* wanted - have, linked by chunk.link */
+ChunkSet have_set; /* the chunks in have, by binary hash */
+ChunkSet missing_set; /* the chunks in missing, by binary hash */
 int sock; /* socket fd for local peer */
 char *user_get_chunk_file; /* path of the output file to store data */
 char *user_output_filename; /* path of the output file to store data */
-
-/*
-  Returns 1 if the chunk can be identified with the given hex hash, 0
-  otherwise.
-*/
-int compare_chunk_by_hex_wrapper(const void *c, const void *hash);
-
-/*
-  Returns 1 if the chunk can be identified with the given bin hash, 0
-  otherwise.
-*/
-int compare_chunk_by_bin_wrapper(const void *c, const void *hash);
+int user_output_fd; /* the output file, written to as chunks are verified */
 
 /*
   Returns the peer with the given peer address, NULL if no match is found.
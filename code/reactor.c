@@ -0,0 +1,137 @@
+/*
+  epoll based event loop
+*/
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "reactor.h"
+#include "timer_wheel.h"
+#include "mytime.h"
+#include "log.h"
+
+typedef struct reactor_source {
+    reactor_handler handler;
+    void *arg;
+    int is_timer; /* expirations are read before the handler is called */
+} reactor_source;
+
+static int epoll_fd = -1;
+static reactor_source sources[REACTOR_MAX_FDS]; /* indexed by descriptor */
+
+int reactor_init(void) {
+    if ((epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        LOG_ERROR("Failed to create epoll instance.\n");
+        return -1;
+    }
+
+    memset(sources, 0, sizeof(sources));
+    return 0;
+}
+
+int reactor_add(int fd, uint32_t events, reactor_handler handler, void *arg) {
+    struct epoll_event ev;
+
+    if (fd < 0 || fd >= REACTOR_MAX_FDS || sources[fd].handler != NULL) {
+        LOG("Cannot register descriptor (%d).\n", fd);
+        return -1;
+    }
+
+    memset(&ev, 0, sizeof(ev));
+    ev.events = events;
+    ev.data.fd = fd;
+
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        LOG_ERROR("Failed to watch descriptor (%d): %s.\n", fd,
+                  strerror(errno));
+        return -1;
+    }
+
+    sources[fd].handler = handler;
+    sources[fd].arg = arg;
+    sources[fd].is_timer = 0;
+    return 0;
+}
+
+void reactor_del(int fd) {
+    if (fd < 0 || fd >= REACTOR_MAX_FDS || sources[fd].handler == NULL) {
+        return;
+    }
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    memset(&(sources[fd]), 0, sizeof(reactor_source));
+}
+
+int reactor_add_timer(unsigned interval_ms, reactor_handler handler,
+                      void *arg) {
+    struct itimerspec its;
+    int fd;
+
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (fd < 0) {
+        LOG_ERROR("Failed to create timer.\n");
+        return -1;
+    }
+
+    its.it_interval.tv_sec = interval_ms / 1000;
+    its.it_interval.tv_nsec = (interval_ms % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+
+    if (timerfd_settime(fd, 0, &its, NULL) < 0 ||
+        reactor_add(fd, EPOLLIN, handler, arg) < 0) {
+        LOG_ERROR("Failed to arm timer.\n");
+        close(fd);
+        return -1;
+    }
+
+    sources[fd].is_timer = 1;
+    return fd;
+}
+
+void reactor_run(void) {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+    reactor_source *src;
+    uint64_t expirations;
+    int i, n, fd;
+
+    while (1) {
+        mytime_update();
+        n = epoll_wait(epoll_fd, events, REACTOR_MAX_EVENTS,
+                       timer_wheel_next_timeout(millitime(NULL)));
+
+        /* every handler of this round reads the same cached time */
+        mytime_update();
+
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERROR("epoll_wait failed: %s.\n", strerror(errno));
+            return;
+        }
+
+        for (i = 0; i < n; i++) {
+            fd = events[i].data.fd;
+            src = &(sources[fd]);
+
+            /* an earlier handler in this round may have removed it */
+            if (src->handler == NULL) {
+                continue;
+            }
+
+            if (src->is_timer &&
+                read(fd, &expirations, sizeof(expirations)) < 0) {
+                continue;
+            }
+
+            src->handler(fd, events[i].events, src->arg);
+        }
+
+        /* deadlines are checked whatever the traffic */
+        timer_wheel_expire(millitime(NULL));
+    }
+}
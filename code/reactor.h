@@ -0,0 +1,61 @@
+/*
+  The reactor waits on every descriptor the peer cares about with a single
+  epoll instance and calls the handler registered for each one that becomes
+  ready.  Timeouts are delivered the same way through timerfds, so the peer
+  loop has no select timeout to tune and new descriptors (per-peer sockets,
+  a control socket) only need to be registered.
+*/
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <inttypes.h>
+
+#define REACTOR_MAX_FDS 256 /* descriptors are indexed directly */
+#define REACTOR_MAX_EVENTS 32 /* events taken per epoll_wait */
+
+/*
+  Called with the ready descriptor, the epoll events reported for it, and the
+  argument given at registration.
+*/
+typedef void (*reactor_handler)(int fd, uint32_t events, void *arg);
+
+/*
+  Create the epoll instance.
+
+  Returns 0 if successful, -1 otherwise.
+*/
+int reactor_init(void);
+
+/*
+  Register handler for the descriptor fd with the given epoll events.  With
+  EPOLLET in events, the handler must consume everything that is ready
+  before it returns, since it is not called again until new data arrives.
+
+  Returns 0 if successful, -1 otherwise.
+*/
+int reactor_add(int fd, uint32_t events, reactor_handler handler, void *arg);
+
+/*
+  Stop watching the descriptor fd.  The descriptor is not closed.
+*/
+void reactor_del(int fd);
+
+/*
+  Create a timerfd that fires every interval_ms milliseconds and register
+  handler for it.  The expirations are read by the reactor before handler is
+  called.
+
+  Returns the timer descriptor if successful, -1 otherwise.
+*/
+int reactor_add_timer(unsigned interval_ms, reactor_handler handler,
+                      void *arg);
+
+/*
+  Wait for events and dispatch them to their handlers.  Every iteration also
+  expires the timers of the timer wheel that are due, and epoll_wait sleeps
+  no longer than the next deadline.  Never returns unless epoll_wait fails.
+*/
+void reactor_run(void);
+
+#endif
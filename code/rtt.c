@@ -0,0 +1,79 @@
+/*
+  Round-trip time estimation and the retransmission timeout
+*/
+
+#include "rtt.h"
+
+#define MAX(a,b) (a < b ? b : a)
+
+/*
+  Keep the timeout within [RTO_MIN, RTO_MAX].
+*/
+static nstime_t clamp_rto(nstime_t rto) {
+    if (rto < RTO_MIN) {
+        return RTO_MIN;
+    }
+
+    return (rto > RTO_MAX) ? RTO_MAX : rto;
+}
+
+void rtt_init(RttEstimator *rtt) {
+    rtt->srtt = 0;
+    rtt->rttvar = 0;
+    rtt->rto = RTO_INITIAL;
+    rtt->backoff = 0;
+    rtt->timed_seq = 0;
+    rtt->timed_at = 0;
+}
+
+void rtt_start(RttEstimator *rtt, uint32_t seq) {
+    if (rtt->timed_seq == 0) {
+        rtt->timed_seq = seq;
+        nanotime(&(rtt->timed_at));
+    }
+}
+
+int rtt_ack(RttEstimator *rtt, uint32_t ack) {
+    if (rtt->timed_seq == 0 || ack < rtt->timed_seq) {
+        return 0;
+    }
+
+    rtt->timed_seq = 0;
+    rtt_sample(rtt, nanotime(NULL) - rtt->timed_at);
+    return 1;
+}
+
+void rtt_sample(RttEstimator *rtt, nstime_t sample) {
+    nstime_t err;
+
+    if (rtt->srtt == 0) {
+        /* the first measurement */
+        rtt->srtt = sample;
+        rtt->rttvar = sample / 2;
+    }
+    else {
+        /* rttvar = 3/4 rttvar + 1/4 |srtt - sample|,
+           srtt = 7/8 srtt + 1/8 sample */
+        err = (rtt->srtt > sample) ? rtt->srtt - sample : sample - rtt->srtt;
+        rtt->rttvar = rtt->rttvar - rtt->rttvar / 4 + err / 4;
+        rtt->srtt = rtt->srtt - rtt->srtt / 8 + sample / 8;
+    }
+
+    /* a sample from a packet sent once ends the backoff */
+    rtt->backoff = 0;
+    rtt->rto = clamp_rto(rtt->srtt + MAX(RTO_GRANULARITY, 4 * rtt->rttvar));
+}
+
+void rtt_backoff(RttEstimator *rtt) {
+    rtt->backoff++;
+    rtt->rto = clamp_rto(rtt->rto * 2);
+    rtt->timed_seq = 0;
+}
+
+nstime_t rtt_smoothed(RttEstimator *rtt, nstime_t def) {
+    return rtt->srtt ? rtt->srtt : def;
+}
+
+mytime_t rtt_timeout_ms(RttEstimator *rtt) {
+    return (mytime_t) ((rtt->rto + NSEC_PER_MSEC - 1) / NSEC_PER_MSEC);
+}
@@ -0,0 +1,72 @@
+/*
+  Round-trip time estimation and the retransmission timeout (RFC 6298).
+
+  Each transfer keeps a smoothed round-trip time and its mean deviation,
+  updated from one timed packet at a time, and derives its retransmission
+  timeout from them.  Every timeout doubles the timeout until a new sample
+  arrives.  Following Karn's rule, a packet that has been sent again is never
+  timed: its acknowledgement could be for either copy.
+*/
+
+#ifndef RTT_H
+#define RTT_H
+
+#include <inttypes.h>
+
+#include "mytime.h"
+
+#define RTO_INITIAL (1000 * NSEC_PER_MSEC) /* before the first sample */
+#define RTO_MIN (200 * NSEC_PER_MSEC)
+#define RTO_MAX (3000 * NSEC_PER_MSEC)
+#define RTO_GRANULARITY NSEC_PER_MSEC /* of the timer wheel */
+
+typedef struct {
+    nstime_t srtt, /* smoothed round-trip time, 0 before the first sample */
+        rttvar, /* mean deviation of the round-trip time */
+        rto; /* current retransmission timeout, backoff included */
+    unsigned backoff; /* timeouts since the last sample */
+
+    uint32_t timed_seq; /* sequence number being timed, 0 if none */
+    nstime_t timed_at; /* when it was sent */
+} RttEstimator;
+
+/*
+  Start with no samples and the initial timeout.
+*/
+void rtt_init(RttEstimator *rtt);
+
+/*
+  Time the packet seq, sent for the first time just now, unless another
+  packet is already being timed.
+*/
+void rtt_start(RttEstimator *rtt, uint32_t seq);
+
+/*
+  Take a sample if ack acknowledges the timed packet.
+
+  Returns 1 if a sample was taken, 0 otherwise.
+*/
+int rtt_ack(RttEstimator *rtt, uint32_t ack);
+
+/*
+  Fold a round-trip time measurement into the estimate, and recompute the
+  timeout without backoff.
+*/
+void rtt_sample(RttEstimator *rtt, nstime_t sample);
+
+/*
+  Double the timeout after it expired, up to RTO_MAX, and stop timing.
+*/
+void rtt_backoff(RttEstimator *rtt);
+
+/*
+  Returns the smoothed round-trip time, or def before the first sample.
+*/
+nstime_t rtt_smoothed(RttEstimator *rtt, nstime_t def);
+
+/*
+  Returns the current retransmission timeout in milliseconds.
+*/
+mytime_t rtt_timeout_ms(RttEstimator *rtt);
+
+#endif
@@ -0,0 +1,216 @@
+/*
+  The sender's per-packet scoreboard
+*/
+
+#include <string.h>
+
+#include "scoreboard.h"
+#include "slab.h"
+
+static SlabCache scoreboard_cache;
+static int scoreboard_cache_ready;
+
+Scoreboard *scoreboard_alloc(void) {
+    if (!scoreboard_cache_ready) {
+        slab_cache_init(&scoreboard_cache, "scoreboard", sizeof(Scoreboard),
+                        SLAB_HUGEPAGES);
+        scoreboard_cache_ready = 1;
+    }
+
+    /* slab objects come zeroed: every packet SB_UNSENT, nothing in flight */
+    return slab_alloc(&scoreboard_cache);
+}
+
+void scoreboard_free(Scoreboard *sb) {
+    if (sb != NULL) {
+        slab_free(&scoreboard_cache, sb);
+    }
+}
+
+void scoreboard_sent(Scoreboard *sb, uint32_t seq) {
+    SbPacket *p = &(sb->packets[seq - 1]);
+
+    if (p->state == SB_UNSENT) {
+        sb->high_sent = seq;
+    }
+    else {
+        if (p->state == SB_LOST) {
+            sb->lost--;
+        }
+        p->retransmits++;
+        sb->retransmits++;
+    }
+
+    p->state = SB_IN_FLIGHT;
+    p->order = ++(sb->orders);
+    nanotime(&(p->sent_at));
+    sb->in_flight++;
+}
+
+uint32_t scoreboard_next_lost(Scoreboard *sb) {
+    uint32_t seq;
+
+    if (sb->lost == 0) {
+        return 0;
+    }
+
+    for (seq = sb->acked + 1; seq <= sb->high_sent; seq++) {
+        if (sb->packets[seq - 1].state == SB_LOST) {
+            return seq;
+        }
+    }
+
+    return 0;
+}
+
+/*
+  Move the packet seq to the delivered state, and keep track of the latest
+  transmissions delivered and of the latest first transmission delivered.
+
+  Returns 1 if the packet was not delivered before, 0 otherwise.
+*/
+static int deliver(Scoreboard *sb, uint32_t seq, uint8_t state,
+                   SbPacket **latest) {
+    SbPacket *p = &(sb->packets[seq - 1]);
+    uint32_t order;
+    int i;
+
+    if (p->state == SB_IN_FLIGHT) {
+        sb->in_flight--;
+    }
+    else if (p->state == SB_LOST) {
+        sb->lost--;
+    }
+    else {
+        /* unsent, or delivered already (a SACKed packet now ACKed) */
+        if (p->state == SB_SACKED) {
+            p->state = state;
+        }
+        return 0;
+    }
+
+    p->state = state;
+
+    /* insert into the latest transmissions delivered */
+    order = p->order;
+    for (i = 0; i < SB_DUP_THRESH; i++) {
+        if (order > sb->delivered[i]) {
+            memmove(&(sb->delivered[i + 1]), &(sb->delivered[i]),
+                    (SB_DUP_THRESH - 1 - i) * sizeof(uint32_t));
+            sb->delivered[i] = order;
+            break;
+        }
+    }
+
+    /* resent packets are never timed (Karn's rule) */
+    if (p->retransmits == 0 &&
+        (*latest == NULL || p->sent_at > (*latest)->sent_at)) {
+        *latest = p;
+    }
+
+    return 1;
+}
+
+/*
+  Mark lost every packet in flight that was sent before SB_DUP_THRESH
+  packets that have since been delivered.
+*/
+static void detect_losses(Scoreboard *sb) {
+    uint32_t threshold = sb->delivered[SB_DUP_THRESH - 1], seq;
+    SbPacket *p;
+
+    if (threshold == 0) {
+        return;
+    }
+
+    for (seq = sb->acked + 1; seq <= sb->high_sent && sb->in_flight; seq++) {
+        p = &(sb->packets[seq - 1]);
+
+        if (p->state == SB_IN_FLIGHT && p->order < threshold) {
+            p->state = SB_LOST;
+            sb->in_flight--;
+            sb->lost++;
+        }
+    }
+}
+
+unsigned scoreboard_ack(Scoreboard *sb, uint32_t ack, const uint8_t *sack,
+                        uint16_t sack_len, nstime_t *rtt) {
+    SbPacket *latest = NULL;
+    unsigned delivered = 0, i, bit;
+    uint32_t seq, cumulative = ack;
+
+    /* nothing past what has been sent can be acknowledged; the SACK bitmap
+       stays relative to the ACK number as sent */
+    if (cumulative > sb->high_sent) {
+        cumulative = sb->high_sent;
+    }
+
+    for (seq = sb->acked + 1; seq <= cumulative; seq++) {
+        delivered += deliver(sb, seq, SB_ACKED, &latest);
+    }
+
+    if (cumulative > sb->acked) {
+        sb->acked = cumulative;
+    }
+
+    /* bit i of the bitmap is the packet ack + 1 + i, so an ACK at or past
+       the highest packet sent has nothing to SACK (and would wrap) */
+    if (ack >= sb->high_sent) {
+        sack_len = 0;
+    }
+
+    for (i = 0; i < sack_len; i++) {
+        for (bit = 0; sack[i] >> bit; bit++) {
+            seq = ack + 1 + i * 8 + bit;
+
+            /* only what has been sent can have been received */
+            if (((sack[i] >> bit) & 1) && seq > sb->acked &&
+                seq <= sb->high_sent) {
+                delivered += deliver(sb, seq, SB_SACKED, &latest);
+            }
+        }
+    }
+
+    *rtt = (latest != NULL) ? nanotime(NULL) - latest->sent_at : 0;
+
+    if (delivered > 0) {
+        detect_losses(sb);
+    }
+
+    return delivered;
+}
+
+int scoreboard_mark_lost(Scoreboard *sb, uint32_t seq) {
+    SbPacket *p;
+
+    if (seq == 0 || seq > sb->high_sent) {
+        return 0;
+    }
+
+    p = &(sb->packets[seq - 1]);
+
+    if (p->state != SB_IN_FLIGHT || p->retransmits > 0) {
+        return 0;
+    }
+
+    p->state = SB_LOST;
+    sb->in_flight--;
+    sb->lost++;
+    return 1;
+}
+
+void scoreboard_timeout(Scoreboard *sb) {
+    uint32_t seq;
+    SbPacket *p;
+
+    for (seq = sb->acked + 1; seq <= sb->high_sent && sb->in_flight; seq++) {
+        p = &(sb->packets[seq - 1]);
+
+        if (p->state == SB_IN_FLIGHT) {
+            p->state = SB_LOST;
+            sb->in_flight--;
+            sb->lost++;
+        }
+    }
+}
@@ -0,0 +1,97 @@
+/*
+  The sender's scoreboard of one transfer: the state of every DATA packet
+  of the chunk, when it was last sent, how often it has been resent, and
+  whether the receiver has acknowledged it cumulatively or selectively.
+
+  From it the sender knows how many packets are really in flight (the
+  pipe), which packets are lost and must be resent, and which round-trip
+  times may be sampled.  A packet is taken as lost once SB_DUP_THRESH
+  packets sent after it have been delivered, which counts a resent packet
+  from the time it was resent.
+*/
+
+#ifndef SCOREBOARD_H
+#define SCOREBOARD_H
+
+#include <inttypes.h>
+
+#include "chunk.h"
+#include "mytime.h"
+
+#define SB_DUP_THRESH 3 /* later deliveries that make a packet lost */
+
+enum sb_state {
+    SB_UNSENT,
+    SB_IN_FLIGHT, /* sent, and neither delivered nor lost */
+    SB_LOST, /* to be resent */
+    SB_SACKED, /* selectively acknowledged */
+    SB_ACKED /* covered by the cumulative ACK */
+};
+
+typedef struct {
+    nstime_t sent_at; /* time of the last transmission */
+    uint32_t order; /* number of the last transmission on the transfer */
+    uint8_t state; /* enum sb_state */
+    uint8_t retransmits; /* times the packet has been resent */
+} SbPacket;
+
+typedef struct {
+    SbPacket packets[MAX_SEQ_NUM]; /* packet seq is at packets[seq - 1] */
+    uint32_t acked, /* the cumulative ACK: every packet up to it is ACKed */
+        high_sent; /* highest sequence number sent */
+    unsigned in_flight, /* packets in SB_IN_FLIGHT: the pipe */
+        lost, /* packets in SB_LOST */
+        retransmits; /* packets resent over the transfer */
+    uint32_t orders; /* transmissions so far */
+    /* the SB_DUP_THRESH latest transmissions delivered, latest first */
+    uint32_t delivered[SB_DUP_THRESH];
+} Scoreboard;
+
+/*
+  Allocate an empty scoreboard.
+
+  Returns the scoreboard if successful, NULL otherwise.
+*/
+Scoreboard *scoreboard_alloc(void);
+
+/*
+  Free a scoreboard allocated by scoreboard_alloc.
+*/
+void scoreboard_free(Scoreboard *sb);
+
+/*
+  Record that the packet seq, either the next new packet or a lost one, is
+  being sent now.
+*/
+void scoreboard_sent(Scoreboard *sb, uint32_t seq);
+
+/*
+  Returns the lowest packet marked lost, 0 if there is none.
+*/
+uint32_t scoreboard_next_lost(Scoreboard *sb);
+
+/*
+  Apply an ACK of ack with sack_len bytes of SACK bitmap (see packet.h),
+  then mark the packets that the deliveries show to be lost.  If a packet
+  that was never resent is delivered, *rtt is set to the time since the
+  latest of them was sent; otherwise *rtt is set to 0.
+
+  Returns the number of packets newly delivered.
+*/
+unsigned scoreboard_ack(Scoreboard *sb, uint32_t ack, const uint8_t *sack,
+                        uint16_t sack_len, nstime_t *rtt);
+
+/*
+  Mark the packet seq lost if it is in flight and has never been resent;
+  used when duplicate ACKs come without SACKs.
+
+  Returns 1 if the packet was marked, 0 otherwise.
+*/
+int scoreboard_mark_lost(Scoreboard *sb, uint32_t seq);
+
+/*
+  Mark every packet in flight lost, after a retransmission timeout.
+*/
+void scoreboard_timeout(Scoreboard *sb);
+
+#endif
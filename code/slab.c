@@ -0,0 +1,192 @@
+/*
+  A slab allocator for fixed-size objects
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "slab.h"
+#include "log.h"
+
+#define SLAB_ALIGN 16 /* alignment of every object */
+#define SLAB_CACHE_LINE 64
+#define ALIGN_UP(n, a) (((n) + (a) - 1) & ~((size_t) (a) - 1))
+
+/* objects are carved out after the slab header, starting on a cache line so
+ * that objects sized in whole cache lines never straddle one */
+#define SLAB_FIRST_OBJECT ALIGN_UP(sizeof(SlabPage), SLAB_CACHE_LINE)
+
+static SlabCache *caches[SLAB_MAX_CACHES]; /* reported by slab_log_stats */
+static unsigned cache_count;
+
+/*
+  Return the size of every slab of the cache.  Slabs are aligned to their
+  size so the slab an object lives in is found by masking its address.
+*/
+static size_t slab_size(SlabCache *cache) {
+    return cache->hugepages ? SLAB_HUGE_SIZE : SLAB_SIZE;
+}
+
+static SlabPage *slab_of(SlabCache *cache, void *obj) {
+    uintptr_t mask = slab_size(cache) - 1;
+
+    return (SlabPage *) ((uintptr_t) obj & ~mask);
+}
+
+/*
+  Map size bytes aligned to size, trying huge pages first if asked to.  The
+  result of a MAP_HUGETLB mapping is aligned to the huge page size already;
+  a mapping of normal pages is over-allocated and trimmed to the alignment.
+
+  Returns the mapping or NULL, and sets *huge if it is backed by huge pages.
+*/
+static void *map_aligned(size_t size, int hugepages, int *huge) {
+    uint8_t *addr, *aligned;
+
+    *huge = 0;
+
+#ifdef MAP_HUGETLB
+    if (hugepages) {
+        addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+        if (addr != MAP_FAILED) {
+            *huge = 1;
+            return addr;
+        }
+
+        LOG_INFO("No huge pages available, falling back to normal pages.\n");
+    }
+#endif
+
+    addr = mmap(NULL, 2 * size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+
+    aligned = (uint8_t *) ALIGN_UP((uintptr_t) addr, size);
+
+    if (aligned > addr) {
+        munmap(addr, aligned - addr);
+    }
+    munmap(aligned + size, addr + size - aligned);
+
+#ifdef MADV_HUGEPAGE
+    /* let transparent huge pages back the slab if the kernel has them */
+    if (hugepages) {
+        madvise(aligned, size, MADV_HUGEPAGE);
+    }
+#endif
+
+    return aligned;
+}
+
+/*
+  Map a new slab.  Its objects are carved out one at a time as they are
+  first needed, so pages of the slab are only touched once they are used.
+
+  Returns 0 if successful, -1 otherwise.
+*/
+static int slab_grow(SlabCache *cache) {
+    size_t size = slab_size(cache);
+    SlabPage *page;
+    int huge;
+
+    if ((page = map_aligned(size, cache->hugepages, &huge)) == NULL) {
+        LOG_ERROR("Failed to map a new slab for (%s).\n", cache->name);
+        return -1;
+    }
+
+    page->size = size;
+    page->huge = huge;
+    page->in_use = 0;
+    page->capacity = (size - SLAB_FIRST_OBJECT) / cache->obj_size;
+    page->next = cache->pages;
+    cache->pages = page;
+
+    cache->fresh = (uint8_t *) page + SLAB_FIRST_OBJECT;
+    cache->fresh_end = cache->fresh + page->capacity * cache->obj_size;
+    cache->slabs++;
+    cache->capacity += page->capacity;
+
+    return 0;
+}
+
+void slab_cache_init(SlabCache *cache, const char *name, size_t obj_size,
+                     int hugepages) {
+    memset(cache, 0, sizeof(SlabCache));
+
+    cache->name = name;
+    cache->obj_size = ALIGN_UP(obj_size < sizeof(void *) ?
+                               sizeof(void *) : obj_size, SLAB_ALIGN);
+    cache->hugepages = hugepages;
+
+    if (cache_count < SLAB_MAX_CACHES) {
+        caches[cache_count++] = cache;
+    }
+}
+
+void *slab_alloc(SlabCache *cache) {
+    void *obj;
+
+    if (cache->free_list != NULL) {
+        obj = cache->free_list;
+        cache->free_list = *(void **) obj;
+        memset(obj, 0, cache->obj_size);
+    } else {
+        /* a fresh mapping is zeroed already */
+        if (cache->fresh == cache->fresh_end && slab_grow(cache) < 0) {
+            return NULL;
+        }
+
+        obj = cache->fresh;
+        cache->fresh += cache->obj_size;
+    }
+
+    slab_of(cache, obj)->in_use++;
+    if (++cache->in_use > cache->peak) {
+        cache->peak = cache->in_use;
+    }
+
+    return obj;
+}
+
+void slab_free(SlabCache *cache, void *obj) {
+    if (obj == NULL) {
+        return;
+    }
+
+    /* slabs are kept mapped once the objects in them are freed; the caches
+     * hold long-lived objects whose number levels off quickly */
+    slab_of(cache, obj)->in_use--;
+    cache->in_use--;
+
+    *(void **) obj = cache->free_list;
+    cache->free_list = obj;
+}
+
+void slab_cache_log_stats(SlabCache *cache) {
+    SlabPage *page;
+    unsigned i = 0;
+
+    LOG("slab (%s): %zu byte objects, %u/%u in use, peak %u, %u slabs\n",
+        cache->name, cache->obj_size, cache->in_use, cache->capacity,
+        cache->peak, cache->slabs);
+
+    for (page = cache->pages; page != NULL; page = page->next, i++) {
+        LOG("slab (%s) #%u: %u/%u in use, %zu bytes%s\n", cache->name, i,
+            page->in_use, page->capacity, page->size,
+            page->huge ? " in huge pages" : "");
+    }
+}
+
+void slab_log_stats(void) {
+    unsigned i;
+
+    for (i = 0; i < cache_count; i++) {
+        slab_cache_log_stats(caches[i]);
+    }
+}
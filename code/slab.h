@@ -0,0 +1,77 @@
+/*
+  A slab allocator for fixed-size objects.
+
+  Objects of one type are carved out of large page-aligned slabs mapped
+  straight from the kernel, and freed objects are kept on a free list to be
+  handed out again, so the long-lived protocol objects (transfers, chunks)
+  sit packed together instead of being scattered over the heap.  A slab can
+  optionally be backed by huge pages to take fewer TLB entries; if no huge
+  pages are available the allocator quietly falls back to normal pages.
+*/
+
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stddef.h>
+#include <inttypes.h>
+
+#define SLAB_SIZE (64 * 1024) /* bytes mapped per slab of normal pages */
+#define SLAB_HUGE_SIZE (2 * 1024 * 1024) /* bytes mapped per huge page slab */
+#define SLAB_MAX_CACHES 8 /* caches reported by slab_log_stats */
+
+/* build with -DSLAB_HUGEPAGES=1 to back every cache with huge pages */
+#ifndef SLAB_HUGEPAGES
+#define SLAB_HUGEPAGES 0
+#endif
+
+typedef struct SlabPage {
+    struct SlabPage *next; /* the next slab of the cache */
+    size_t size; /* bytes mapped for this slab */
+    unsigned capacity, in_use; /* objects carved out of / taken from it */
+    int huge; /* whether the slab is backed by huge pages */
+} SlabPage;
+
+typedef struct {
+    const char *name; /* used when reporting statistics */
+    size_t obj_size; /* object size, rounded up for alignment */
+    int hugepages; /* whether new slabs should try huge pages */
+    void *free_list; /* freed objects, linked through their first word */
+    uint8_t *fresh, *fresh_end; /* never used objects of the newest slab */
+    SlabPage *pages; /* every slab of the cache */
+    unsigned slabs, capacity, in_use, peak; /* cache wide occupancy */
+} SlabCache;
+
+/*
+  Initialize an empty cache of objects of obj_size bytes.  No memory is
+  mapped until the first object is allocated.  The cache is registered for
+  slab_log_stats.
+*/
+void slab_cache_init(SlabCache *cache, const char *name, size_t obj_size,
+                     int hugepages);
+
+/*
+  Take a zeroed object from the cache, mapping a new slab if every object
+  is in use.
+
+  \return
+  if successful: an object that must be given back with slab_free
+  else: NULL
+*/
+void *slab_alloc(SlabCache *cache);
+
+/*
+  Give an object back to the cache.  NULL is ignored.
+*/
+void slab_free(SlabCache *cache, void *obj);
+
+/*
+  Log the occupancy of the cache and of each of its slabs.
+*/
+void slab_cache_log_stats(SlabCache *cache);
+
+/*
+  Log the occupancy of every registered cache.
+*/
+void slab_log_stats(void);
+
+#endif
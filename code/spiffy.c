@@ -1,3 +1,4 @@
+#define _GNU_SOURCE /* for sendmmsg and recvmmsg */
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <stdlib.h>
@@ -47,6 +48,100 @@ ssize_t spiffy_sendto(int s, const void *msg, size_t len, int flags, const struc
 	return retVal;
 }
 
+/* Scatter-gather counterpart of spiffy_sendto: the spiffy header goes out as
+   one more iovec in front of the caller's, so the payload is never copied. */
+ssize_t spiffy_sendmsg(int s, const struct msghdr *msg, int flags) {
+	struct iovec iov[SPIFFY_MAX_IOV + 1];
+	struct msghdr newmsg;
+	spiffy_header s_head;
+	struct sockaddr_in *to = (struct sockaddr_in *) msg->msg_name;
+	ssize_t retVal;
+
+	if (0 == giSpiffyEnabled) {
+		return sendmsg(s, msg, flags);
+	}
+
+	if (msg->msg_iovlen > SPIFFY_MAX_IOV) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (to == NULL || to->sin_family != AF_INET) {
+		fprintf(stderr, "spiffy_sendmsg:  must specify AF_INET.  FIX YOUR CODE.\n");
+		errno = ENOTSUP;
+		return -1;
+	}
+	s_head.ID = htonl(glNodeID);
+	s_head.lSrcAddr = glSrcAddr;
+	s_head.lSrcPort = gsSrcPort;
+	s_head.lDestAddr = to->sin_addr.s_addr;
+	s_head.lDestPort = to->sin_port;
+
+	iov[0].iov_base = &s_head;
+	iov[0].iov_len = sizeof(spiffy_header);
+	memcpy(iov + 1, msg->msg_iov, msg->msg_iovlen * sizeof(struct iovec));
+
+	memset(&newmsg, 0, sizeof(newmsg));
+	newmsg.msg_name = &gsSpiffyRouter;
+	newmsg.msg_namelen = sizeof(gsSpiffyRouter);
+	newmsg.msg_iov = iov;
+	newmsg.msg_iovlen = msg->msg_iovlen + 1;
+
+	retVal = sendmsg(s, &newmsg, flags);
+	if (retVal > 0) retVal -= sizeof(spiffy_header);
+	return retVal;
+}
+
+/* Batched counterpart of spiffy_sendmsg.  Like sendmmsg, it may send fewer
+   than vlen messages and returns how many were sent. */
+int spiffy_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags) {
+	struct iovec iov[SPIFFY_MAX_BATCH][SPIFFY_MAX_IOV + 1];
+	struct mmsghdr newvec[SPIFFY_MAX_BATCH];
+	spiffy_header s_head[SPIFFY_MAX_BATCH];
+	struct msghdr *msg;
+	struct sockaddr_in *to;
+	unsigned int i;
+
+	if (0 == giSpiffyEnabled) {
+		return sendmmsg(s, msgvec, vlen, flags);
+	}
+
+	if (vlen > SPIFFY_MAX_BATCH) {
+		vlen = SPIFFY_MAX_BATCH;
+	}
+
+	memset(newvec, 0, vlen * sizeof(struct mmsghdr));
+	for (i = 0; i < vlen; i++) {
+		msg = &(msgvec[i].msg_hdr);
+		to = (struct sockaddr_in *) msg->msg_name;
+
+		if (msg->msg_iovlen > SPIFFY_MAX_IOV) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (to == NULL || to->sin_family != AF_INET) {
+			fprintf(stderr, "spiffy_sendmmsg:  must specify AF_INET.  FIX YOUR CODE.\n");
+			errno = ENOTSUP;
+			return -1;
+		}
+		s_head[i].ID = htonl(glNodeID);
+		s_head[i].lSrcAddr = glSrcAddr;
+		s_head[i].lSrcPort = gsSrcPort;
+		s_head[i].lDestAddr = to->sin_addr.s_addr;
+		s_head[i].lDestPort = to->sin_port;
+
+		iov[i][0].iov_base = &s_head[i];
+		iov[i][0].iov_len = sizeof(spiffy_header);
+		memcpy(iov[i] + 1, msg->msg_iov, msg->msg_iovlen * sizeof(struct iovec));
+
+		newvec[i].msg_hdr.msg_name = &gsSpiffyRouter;
+		newvec[i].msg_hdr.msg_namelen = sizeof(gsSpiffyRouter);
+		newvec[i].msg_hdr.msg_iov = iov[i];
+		newvec[i].msg_hdr.msg_iovlen = msg->msg_iovlen + 1;
+	}
+
+	return sendmmsg(s, newvec, vlen, flags);
+}
+
 int spiffy_recvfrom (int socket, void *buffer, size_t size, int flags, struct sockaddr *addr, socklen_t *lengthPtr) {
 
 	char *newbuf = NULL;
@@ -87,6 +182,124 @@ int spiffy_recvfrom (int socket, void *buffer, size_t size, int flags, struct so
 	return retVal;
 }
 
+/* Scatter-gather counterpart of spiffy_recvfrom.  The spiffy header is
+   received into an iovec of its own in front of the caller's, and msg_name
+   is rewritten to the original sender. */
+ssize_t spiffy_recvmsg (int socket, struct msghdr *msg, int flags) {
+	struct iovec iov[SPIFFY_MAX_IOV + 1];
+	struct msghdr newmsg;
+	spiffy_header s_head;
+	struct sockaddr_in sRecvAddr;
+	struct sockaddr_in *from;
+	ssize_t retVal;
+
+	if (!giSpiffyEnabled) {
+		return recvmsg(socket, msg, flags);
+	}
+
+	if (msg->msg_iovlen > SPIFFY_MAX_IOV) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	iov[0].iov_base = &s_head;
+	iov[0].iov_len = sizeof(spiffy_header);
+	memcpy(iov + 1, msg->msg_iov, msg->msg_iovlen * sizeof(struct iovec));
+
+	memset(&newmsg, 0, sizeof(newmsg));
+	newmsg.msg_name = &sRecvAddr;
+	newmsg.msg_namelen = sizeof(sRecvAddr);
+	newmsg.msg_iov = iov;
+	newmsg.msg_iovlen = msg->msg_iovlen + 1;
+
+	retVal = recvmsg(socket, &newmsg, flags);
+	msg->msg_flags = newmsg.msg_flags;
+
+	if (retVal < 0) {
+		return retVal;
+	}
+	/* a datagram too short to carry a spiffy header carries nothing */
+	if (retVal < (ssize_t) sizeof(spiffy_header)) {
+		return 0;
+	}
+
+	if (msg->msg_name != NULL) {
+		from = (struct sockaddr_in *) msg->msg_name;
+		from->sin_family = AF_INET;
+		from->sin_addr.s_addr = s_head.lSrcAddr;
+		from->sin_port = s_head.lSrcPort;
+		msg->msg_namelen = sizeof(struct sockaddr_in);
+	}
+	return retVal - sizeof(spiffy_header);
+}
+
+/* Batched counterpart of spiffy_recvfrom.  The spiffy header of each datagram
+   is received into its own iovec, so the caller's buffers only ever see the
+   packet, and each msg_name is rewritten to the original sender. */
+int spiffy_recvmmsg (int socket, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout) {
+	struct iovec iov[SPIFFY_MAX_BATCH][SPIFFY_MAX_IOV + 1];
+	struct mmsghdr newvec[SPIFFY_MAX_BATCH];
+	spiffy_header s_head[SPIFFY_MAX_BATCH];
+	struct msghdr *msg;
+	struct sockaddr_in sRecvAddr[SPIFFY_MAX_BATCH];
+	struct sockaddr_in *from;
+	unsigned int i;
+	int retVal;
+
+	if (!giSpiffyEnabled) {
+		return recvmmsg(socket, msgvec, vlen, flags, timeout);
+	}
+
+	if (vlen > SPIFFY_MAX_BATCH) {
+		vlen = SPIFFY_MAX_BATCH;
+	}
+
+	memset(newvec, 0, vlen * sizeof(struct mmsghdr));
+	for (i = 0; i < vlen; i++) {
+		msg = &(msgvec[i].msg_hdr);
+
+		if (msg->msg_iovlen > SPIFFY_MAX_IOV) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		iov[i][0].iov_base = &s_head[i];
+		iov[i][0].iov_len = sizeof(spiffy_header);
+		memcpy(iov[i] + 1, msg->msg_iov, msg->msg_iovlen * sizeof(struct iovec));
+
+		newvec[i].msg_hdr.msg_name = &sRecvAddr[i];
+		newvec[i].msg_hdr.msg_namelen = sizeof(sRecvAddr[i]);
+		newvec[i].msg_hdr.msg_iov = iov[i];
+		newvec[i].msg_hdr.msg_iovlen = msg->msg_iovlen + 1;
+	}
+
+	retVal = recvmmsg(socket, newvec, vlen, flags, timeout);
+
+	for (i = 0; retVal > 0 && i < (unsigned int) retVal; i++) {
+		msg = &(msgvec[i].msg_hdr);
+		msg->msg_flags = newvec[i].msg_hdr.msg_flags;
+
+		/* a datagram too short to carry a spiffy header carries nothing */
+		if (newvec[i].msg_len < sizeof(spiffy_header)) {
+			msgvec[i].msg_len = 0;
+			continue;
+		}
+		msgvec[i].msg_len = newvec[i].msg_len - sizeof(spiffy_header);
+
+		if (msg->msg_name != NULL) {
+			from = (struct sockaddr_in *) msg->msg_name;
+			from->sin_family = AF_INET;
+			from->sin_addr.s_addr = s_head[i].lSrcAddr;
+			from->sin_port = s_head[i].lSrcPort;
+			msg->msg_namelen = sizeof(struct sockaddr_in);
+		}
+	}
+	if (retVal < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+		printf("Error on spiffy_recvmmsg. errno: %d \n", errno);
+	}
+	return retVal;
+}
+
 int spiffy_init (long lNodeID, const struct sockaddr *addr, socklen_t addrlen) {
 
 	char *cSpiffyName = NULL;
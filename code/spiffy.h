@@ -3,8 +3,15 @@
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include "debug.h"
 
+#define SPIFFY_MAX_IOV 8 /* max iovecs spiffy_sendmsg can prepend a header to */
+#define SPIFFY_MAX_BATCH 64 /* max messages spiffy_sendmmsg sends per call */
+
+struct mmsghdr;
+struct timespec;
+
 struct spiffy_header_s {
 	int ID;
 	int lSrcAddr;
@@ -15,7 +22,11 @@ struct spiffy_header_s {
 typedef struct spiffy_header_s spiffy_header;
 
 ssize_t spiffy_sendto(int s, const void *msg, size_t len, int flags, const struct sockaddr *to, socklen_t tolen);
+ssize_t spiffy_sendmsg(int s, const struct msghdr *msg, int flags);
+int spiffy_sendmmsg(int s, struct mmsghdr *msgvec, unsigned int vlen, int flags);
 int spiffy_recvfrom (int socket, void *buffer, size_t size, int flags, struct sockaddr *addr, socklen_t *lengthptr);
+ssize_t spiffy_recvmsg (int socket, struct msghdr *msg, int flags);
+int spiffy_recvmmsg (int socket, struct mmsghdr *msgvec, unsigned int vlen, int flags, struct timespec *timeout);
 int spiffy_init (long lNodeID, const struct sockaddr *addr, socklen_t addrlen);
 
 #endif /* _SPIFFY_H_ */
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <assert.h>
+#include "bitset.h"
+
+#define NBITS 150 /* two full words and a last word of 22 bits */
+
+/*
+  Check count and the low-water mark against the bits, and that no bit past
+  nbits is ever set.
+*/
+static void check_bitset(const Bitset *b) {
+    unsigned i, count = 0, low = b->nbits;
+
+    for (i = 0; i < b->nbits; i++) {
+        if (bitset_test(b, i)) {
+            count++;
+        } else if (low == b->nbits) {
+            low = i;
+        }
+    }
+
+    for (; i < BITSET_MAX_BITS; i++) {
+        assert(!bitset_test(b, i));
+    }
+
+    assert(b->count == count);
+    assert(b->low == low);
+    assert(bitset_full(b) == (count == b->nbits));
+}
+
+static void test_set_across_words(void) {
+    Bitset b;
+
+    bitset_init(&b, NBITS);
+    check_bitset(&b);
+    assert(bitset_next_clear(&b, 0) == 0);
+    assert(bitset_next_set(&b, 0) == NBITS);
+
+    /* the last bit of a word and the first of the next */
+    assert(bitset_set(&b, 63) == 1);
+    assert(bitset_set(&b, 64) == 1);
+    assert(bitset_set(&b, 64) == 0);
+    assert(bitset_test(&b, 63) && bitset_test(&b, 64));
+    assert(!bitset_test(&b, 62) && !bitset_test(&b, 65));
+    check_bitset(&b);
+
+    assert(bitset_next_set(&b, 0) == 63);
+    assert(bitset_next_set(&b, 64) == 64);
+    assert(bitset_next_set(&b, 65) == NBITS);
+    assert(bitset_next_clear(&b, 63) == 65);
+    assert(bitset_next_clear(&b, 0) == 0);
+
+    /* bits at and past nbits are not set */
+    assert(bitset_set(&b, NBITS) == 0);
+    assert(bitset_set(&b, BITSET_MAX_BITS - 1) == 0);
+    check_bitset(&b);
+
+    bitset_clear_all(&b);
+    check_bitset(&b);
+    assert(b.count == 0 && bitset_next_set(&b, 0) == NBITS);
+}
+
+static void test_low_water_mark(void) {
+    Bitset b;
+    unsigned i;
+
+    bitset_init(&b, NBITS);
+
+    /* bits set ahead of the mark leave it in place */
+    for (i = 1; i < 130; i++) {
+        assert(bitset_set(&b, i) == 1);
+    }
+    assert(b.low == 0);
+    check_bitset(&b);
+
+    /* closing the gap moves it over two whole words at once */
+    assert(bitset_set(&b, 0) == 1);
+    assert(b.low == 130);
+    check_bitset(&b);
+
+    /* the scan for clear bits starts at the mark whatever from is */
+    assert(bitset_next_clear(&b, 0) == 130);
+    assert(bitset_next_clear(&b, 140) == 140);
+    assert(bitset_next_set(&b, 129) == 129);
+    assert(bitset_next_set(&b, 130) == NBITS);
+}
+
+static void test_last_partial_word(void) {
+    Bitset b;
+    unsigned i;
+
+    bitset_init(&b, NBITS);
+
+    /* the clear padding past nbits is never reported as a clear bit */
+    for (i = NBITS - 1; i >= 128; i--) {
+        assert(bitset_set(&b, i) == 1);
+    }
+    assert(bitset_next_clear(&b, 128) == NBITS);
+    assert(bitset_next_set(&b, 0) == 128);
+    check_bitset(&b);
+
+    /* filling the rest in ascending order ends at nbits, not past it */
+    for (i = 0; i < 128; i++) {
+        assert(!bitset_full(&b));
+        assert(bitset_set(&b, i) == 1);
+        assert(b.low == (i == 127 ? NBITS : i + 1));
+    }
+    assert(bitset_full(&b));
+    assert(bitset_next_clear(&b, 0) == NBITS);
+    check_bitset(&b);
+}
+
+static void test_sizes(void) {
+    Bitset b;
+    unsigned i;
+
+    /* a bitset of exactly one word, full with no padding */
+    bitset_init(&b, BITSET_WORD_BITS);
+    for (i = 0; i < BITSET_WORD_BITS; i++) {
+        bitset_set(&b, i);
+    }
+    assert(bitset_full(&b) && b.low == BITSET_WORD_BITS);
+    assert(bitset_next_clear(&b, 0) == BITSET_WORD_BITS);
+    check_bitset(&b);
+
+    /* a size past the capacity is cut to it */
+    bitset_init(&b, BITSET_MAX_BITS + 1);
+    assert(b.nbits == BITSET_MAX_BITS);
+    assert(bitset_set(&b, BITSET_MAX_BITS - 1) == 1);
+    assert(bitset_next_set(&b, 0) == BITSET_MAX_BITS - 1);
+    check_bitset(&b);
+
+    /* an empty bitset is full */
+    bitset_init(&b, 0);
+    assert(bitset_full(&b) && bitset_set(&b, 0) == 0);
+    assert(bitset_next_clear(&b, 0) == 0 && bitset_next_set(&b, 0) == 0);
+}
+
+int main() {
+    test_set_across_words();
+    test_low_water_mark();
+    test_last_partial_word();
+    test_sizes();
+
+    printf("bitset: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "chunk_set.h"
+
+#define NCHUNKS 1000
+
+static chunk chunks[NCHUNKS];
+
+/*
+  Give the chunk a hash whose home bucket in a CHUNK_SET_MIN_CAPACITY set is
+  home; tag tells apart chunks with the same home.
+*/
+static void make_chunk(chunk *c, uint64_t home, uint32_t tag) {
+    memset(c->bin_hash, 0, BIN_HASH_SIZE);
+    memcpy(c->bin_hash, &home, sizeof(home));
+    memcpy(c->bin_hash + sizeof(home), &tag, sizeof(tag));
+}
+
+/* the slot holding chunk c, -1 if it is in none */
+static long slot_of(ChunkSet *set, chunk *c) {
+    size_t i;
+
+    for (i = 0; i <= set->mask; i++) {
+        if (set->slots[i] == c) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*
+  Check that every chunk can be reached from its home bucket without
+  crossing an empty slot, and that count matches the occupied slots.
+*/
+static void check_clusters(ChunkSet *set) {
+    size_t i, j, home, used = 0;
+    uint64_t bits;
+
+    for (i = 0; i <= set->mask; i++) {
+        if (set->slots[i] == NULL) {
+            continue;
+        }
+
+        used++;
+        memcpy(&bits, set->slots[i]->bin_hash, sizeof(bits));
+        home = bits & set->mask;
+
+        for (j = home; j != i; j = (j + 1) & set->mask) {
+            assert(set->slots[j] != NULL);
+        }
+
+        assert(chunk_set_find(set, set->slots[i]->bin_hash) == set->slots[i]);
+    }
+
+    assert(used == set->count);
+}
+
+static void test_insert_find(void) {
+    ChunkSet set;
+    chunk other;
+    int i;
+
+    assert(chunk_set_init(&set) == 0);
+
+    for (i = 0; i < 8; i++) {
+        make_chunk(&chunks[i], i * 3, i);
+        assert(chunk_set_insert(&set, &chunks[i]) == 0);
+    }
+    assert(set.count == 8);
+
+    /* a second chunk with the same hash is not added */
+    make_chunk(&other, 0, 0);
+    assert(chunk_set_insert(&set, &other) == 0);
+    assert(set.count == 8);
+    assert(chunk_set_find(&set, other.bin_hash) == &chunks[0]);
+
+    /* a hash not in the set, on an occupied home bucket */
+    make_chunk(&other, 3, 100);
+    assert(chunk_set_find(&set, other.bin_hash) == NULL);
+    assert(chunk_set_remove(&set, other.bin_hash) == NULL);
+
+    for (i = 0; i < 8; i++) {
+        assert(chunk_set_find(&set, chunks[i].bin_hash) == &chunks[i]);
+    }
+    check_clusters(&set);
+
+    chunk_set_clear(&set);
+    assert(set.count == 0);
+    assert(chunk_set_find(&set, chunks[0].bin_hash) == NULL);
+}
+
+static void test_remove_shifts_back(void) {
+    ChunkSet set;
+    int i;
+
+    assert(chunk_set_init(&set) == 0);
+
+    /* one cluster over 10..14: homes 10, 10, 11, 10, 14 */
+    make_chunk(&chunks[0], 10, 0);
+    make_chunk(&chunks[1], 10, 1);
+    make_chunk(&chunks[2], 11, 2);
+    make_chunk(&chunks[3], 10, 3);
+    make_chunk(&chunks[4], 14, 4);
+    for (i = 0; i < 5; i++) {
+        assert(chunk_set_insert(&set, &chunks[i]) == 0);
+        assert(slot_of(&set, &chunks[i]) == 10 + i);
+    }
+
+    /* removing the head moves each entry that may move one slot back; the
+       entry at home in 14 stays */
+    assert(chunk_set_remove(&set, chunks[0].bin_hash) == &chunks[0]);
+    assert(slot_of(&set, &chunks[1]) == 10);
+    assert(slot_of(&set, &chunks[2]) == 11);
+    assert(slot_of(&set, &chunks[3]) == 12);
+    assert(slot_of(&set, &chunks[4]) == 14);
+    assert(set.slots[13] == NULL);
+    check_clusters(&set);
+
+    /* removing the middle leaves no hole in the probe path of the tail */
+    assert(chunk_set_remove(&set, chunks[2].bin_hash) == &chunks[2]);
+    assert(slot_of(&set, &chunks[3]) == 11);
+    check_clusters(&set);
+
+    assert(chunk_set_remove(&set, chunks[0].bin_hash) == NULL);
+    assert(set.count == 3);
+}
+
+static void test_remove_wraparound(void) {
+    ChunkSet set;
+    int i;
+
+    assert(chunk_set_init(&set) == 0);
+    assert(set.mask == CHUNK_SET_MIN_CAPACITY - 1);
+
+    /* a cluster that wraps over the end of the table: homes 62, 62, 63,
+       62 and 0 land in slots 62, 63, 0, 1 and 2 */
+    make_chunk(&chunks[0], 62, 0);
+    make_chunk(&chunks[1], 62, 1);
+    make_chunk(&chunks[2], 63, 2);
+    make_chunk(&chunks[3], 62, 3);
+    make_chunk(&chunks[4], 0, 4);
+    for (i = 0; i < 5; i++) {
+        assert(chunk_set_insert(&set, &chunks[i]) == 0);
+    }
+    assert(slot_of(&set, &chunks[0]) == 62);
+    assert(slot_of(&set, &chunks[1]) == 63);
+    assert(slot_of(&set, &chunks[2]) == 0);
+    assert(slot_of(&set, &chunks[3]) == 1);
+    assert(slot_of(&set, &chunks[4]) == 2);
+
+    /* entries past the end shift back across it */
+    assert(chunk_set_remove(&set, chunks[1].bin_hash) == &chunks[1]);
+    assert(slot_of(&set, &chunks[2]) == 63);
+    assert(slot_of(&set, &chunks[3]) == 0);
+    assert(slot_of(&set, &chunks[4]) == 1);
+    assert(set.slots[2] == NULL);
+    check_clusters(&set);
+
+    assert(chunk_set_remove(&set, chunks[3].bin_hash) == &chunks[3]);
+    assert(slot_of(&set, &chunks[4]) == 0);
+    check_clusters(&set);
+
+    /* an entry at home in slot 0 must not move back across the end */
+    assert(chunk_set_remove(&set, chunks[0].bin_hash) == &chunks[0]);
+    assert(slot_of(&set, &chunks[4]) == 0);
+    assert(chunk_set_remove(&set, chunks[2].bin_hash) == &chunks[2]);
+    assert(slot_of(&set, &chunks[4]) == 0);
+    assert(chunk_set_remove(&set, chunks[4].bin_hash) == &chunks[4]);
+    assert(set.count == 0);
+    check_clusters(&set);
+}
+
+static void test_grow_and_churn(void) {
+    ChunkSet set;
+    int i;
+
+    assert(chunk_set_init(&set) == 0);
+
+    /* 16 home buckets at the end of the table whatever its size, so the
+       clusters are long and wrap around */
+    for (i = 0; i < NCHUNKS; i++) {
+        make_chunk(&chunks[i], -(uint64_t) (i % 16 + 1), i);
+        assert(chunk_set_insert(&set, &chunks[i]) == 0);
+    }
+    assert(set.count == NCHUNKS);
+    assert((set.count * 2) <= set.mask + 1);
+    check_clusters(&set);
+
+    for (i = 0; i < NCHUNKS; i += 2) {
+        assert(chunk_set_remove(&set, chunks[i].bin_hash) == &chunks[i]);
+    }
+    check_clusters(&set);
+
+    for (i = 0; i < NCHUNKS; i++) {
+        assert(chunk_set_find(&set, chunks[i].bin_hash) ==
+               ((i % 2) ? &chunks[i] : NULL));
+    }
+}
+
+int main() {
+    test_insert_find();
+    test_remove_shifts_back();
+    test_remove_wraparound();
+    test_grow_and_churn();
+
+    printf("chunk_set: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/types.h>
+#include "log_record.h"
+
+#define TEXT_LEN 512
+
+/*
+  Parse the site, pack the arguments into a record, send the site through
+  its file entry as log-decode would read it, and render the record with
+  the decoded site into text.
+*/
+static void round_trip(char *text, LogSite *site, ...) {
+    uint8_t entry[TEXT_LEN];
+    LogEntryHeader header;
+    LogSite decoded;
+    LogRecord rec;
+    size_t len;
+    va_list args;
+
+    assert(log_site_parse(site) == 0);
+
+    va_start(args, site);
+    log_record_pack(&rec, site, args);
+    va_end(args);
+
+    len = log_site_encode(entry, sizeof(entry), site);
+    assert(len > sizeof(header));
+    memcpy(&header, entry, sizeof(header));
+    assert(header.type == LOG_ENTRY_SITE);
+    assert(sizeof(header) + header.len == len);
+
+    assert(log_site_decode(&decoded, entry + sizeof(header), header.len) == 0);
+    assert(decoded.id == site->id && decoded.level == site->level);
+    assert(decoded.line == site->line);
+    assert(strcmp(decoded.format, site->format) == 0);
+    assert(decoded.nargs == site->nargs);
+    assert(memcmp(decoded.types, site->types, site->nargs) == 0);
+
+    log_record_render(text, TEXT_LEN, &decoded, &rec);
+}
+
+static void test_integer_types(void) {
+    LogSite site = { "test", 42, 1, "int %d %u %x %c, long %ld %lu, "
+                     "llong %lld, size %zu %zd\n" };
+    char text[TEXT_LEN], expect[TEXT_LEN];
+
+    site.id = 7;
+    round_trip(text, &site, -5, 4000000000u, 0xbeef, 'q', -70000000000L,
+               70000000000UL, -(1LL << 40), (size_t) 1 << 33, (ssize_t) -3);
+    snprintf(expect, sizeof(expect), site.format, -5, 4000000000u, 0xbeef,
+             'q', -70000000000L, 70000000000UL, -(1LL << 40),
+             (size_t) 1 << 33, (ssize_t) -3);
+    assert(strcmp(text, expect) == 0);
+    assert(site.nargs == 9);
+}
+
+static void test_other_types(void) {
+    LogSite site = { "test", 43, 2, "intmax %jd, double %.3f %g, "
+                     "string [%s] [%-6s], pointer %p, 100%%\n" };
+    char text[TEXT_LEN], expect[TEXT_LEN];
+    int x;
+
+    round_trip(text, &site, (intmax_t) -9, 3.14159, 1e-20, "abc", "de",
+               (void *) &x);
+    snprintf(expect, sizeof(expect), site.format, (intmax_t) -9, 3.14159,
+             1e-20, "abc", "de", (void *) &x);
+    assert(strcmp(text, expect) == 0);
+    assert(site.nargs == 6);
+}
+
+static void test_no_arguments(void) {
+    LogSite site = { NULL, 1, 0, "nothing to see, 100%% sure\n" };
+    char text[TEXT_LEN];
+
+    round_trip(text, &site);
+    assert(strcmp(text, "nothing to see, 100% sure\n") == 0);
+    assert(site.nargs == 0);
+}
+
+static void test_null_string(void) {
+    LogSite site = { "test", 1, 0, "[%s]" };
+    char text[TEXT_LEN];
+
+    round_trip(text, &site, (char *) NULL);
+    assert(strcmp(text, "[(null)]") == 0);
+}
+
+static void test_truncated_string(void) {
+    LogSite site = { "test", 1, 0, "%s|%d|%s" };
+    char text[TEXT_LEN], expect[TEXT_LEN], longer[TEXT_LEN];
+
+    memset(longer, 'a', sizeof(longer) - 1);
+    longer[sizeof(longer) - 1] = '\0';
+
+    /* the string is cut to the record, and what follows it is lost */
+    round_trip(text, &site, longer, 5, "b");
+    memset(expect, 'a', LOG_RECORD_ARGS_LEN - 1);
+    strcpy(expect + LOG_RECORD_ARGS_LEN - 1, "|<truncated>|<truncated>");
+    assert(strcmp(text, expect) == 0);
+}
+
+static void test_full_record(void) {
+    LogSite site = { "test", 1, 0, "%s %ld %s" };
+    char text[TEXT_LEN], expect[TEXT_LEN], fill[LOG_RECORD_ARGS_LEN];
+
+    /* a string leaving less than a value of room: the value is lost, and
+       the string after it finds the record full */
+    memset(fill, 'f', sizeof(fill) - 4);
+    fill[sizeof(fill) - 4] = '\0';
+
+    round_trip(text, &site, fill, 12L, "x");
+    strcpy(expect, fill);
+    strcat(expect, " <truncated> <truncated>");
+    assert(strcmp(text, expect) == 0);
+}
+
+static void test_short_buffer(void) {
+    LogSite site = { "test", 1, 0, "%d and %s" };
+    char text[TEXT_LEN];
+    LogRecord rec;
+    size_t len;
+
+    round_trip(text, &site, 123456, "more text");
+    assert(strcmp(text, "123456 and more text") == 0);
+
+    /* render into a buffer too small for the text */
+    log_site_parse(&site);
+    rec.len = 0;
+    len = log_record_render(text, 4, &site, &rec);
+    assert(len == 3 && strlen(text) == 3);
+}
+
+static void test_rejected_formats(void) {
+    const char *formats[] = {
+        "%*d", /* width from an argument */
+        "%.*s", /* precision from an argument */
+        "%Lf", /* long double */
+        "%ls", /* wide string */
+        "%n", /* write-back */
+        "%d %d %d %d %d %d %d %d %d %d %d %d %d", /* more than LOG_MAX_ARGS */
+        NULL
+    };
+    LogSite site = { "test", 1, 0, NULL };
+    int i;
+
+    for (i = 0; formats[i] != NULL; i++) {
+        site.format = formats[i];
+        assert(log_site_parse(&site) == -1);
+    }
+
+    /* LOG_MAX_ARGS conversions are fine */
+    site.format = "%d %d %d %d %d %d %d %d %d %d %d %d";
+    assert(log_site_parse(&site) == 0 && site.nargs == LOG_MAX_ARGS);
+}
+
+static void test_malformed_site_entries(void) {
+    LogSite site = { "func", 3, 1, "%d\n" }, decoded;
+    uint8_t entry[TEXT_LEN];
+    size_t len;
+
+    len = log_site_encode(entry, sizeof(entry), &site);
+    assert(len > 0);
+
+    /* too small a buffer to encode into */
+    assert(log_site_encode(entry, len - 1, &site) == 0);
+
+    /* a payload cut short, or not ending in a NUL */
+    len -= sizeof(LogEntryHeader);
+    assert(log_site_decode(&decoded, entry + sizeof(LogEntryHeader),
+                           len - 1) == -1);
+    assert(log_site_decode(&decoded, entry + sizeof(LogEntryHeader),
+                           4) == -1);
+
+    /* a decoded site with a format that cannot be stored is rejected */
+    site.format = "%*d";
+    len = log_site_encode(entry, sizeof(entry), &site);
+    assert(log_site_decode(&decoded, entry + sizeof(LogEntryHeader),
+                           len - sizeof(LogEntryHeader)) == -1);
+}
+
+int main() {
+    test_integer_types();
+    test_other_types();
+    test_no_arguments();
+    test_null_string();
+    test_truncated_string();
+    test_full_record();
+    test_short_buffer();
+    test_rejected_formats();
+    test_malformed_site_entries();
+
+    printf("log_record: all tests passed\n");
+    return 0;
+}
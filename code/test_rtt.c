@@ -0,0 +1,122 @@
+#include <stdio.h>
+#include <assert.h>
+#include "rtt.h"
+
+#define MS NSEC_PER_MSEC
+
+static void test_first_sample(void) {
+    RttEstimator rtt;
+
+    rtt_init(&rtt);
+    assert(rtt.rto == RTO_INITIAL && rtt_timeout_ms(&rtt) == 1000);
+    assert(rtt_smoothed(&rtt, 7 * MS) == 7 * MS);
+
+    /* srtt = sample, rttvar = sample / 2, rto = srtt + 4 rttvar */
+    rtt_sample(&rtt, 100 * MS);
+    assert(rtt.srtt == 100 * MS && rtt.rttvar == 50 * MS);
+    assert(rtt.rto == 300 * MS && rtt_timeout_ms(&rtt) == 300);
+    assert(rtt_smoothed(&rtt, 7 * MS) == 100 * MS);
+}
+
+static void test_update(void) {
+    RttEstimator rtt;
+
+    rtt_init(&rtt);
+    rtt_sample(&rtt, 100 * MS);
+
+    /* err = 100: rttvar = 50 - 50/4 + 100/4, srtt = 100 - 100/8 + 200/8 */
+    rtt_sample(&rtt, 200 * MS);
+    assert(rtt.rttvar == 62500000 && rtt.srtt == 112500000);
+    assert(rtt.rto == 362500000);
+
+    /* the timeout is rounded up to whole milliseconds */
+    assert(rtt_timeout_ms(&rtt) == 363);
+
+    /* err = 12.5: rttvar = 62.5 - 62.5/4 + 12.5/4,
+       srtt = 112.5 - 112.5/8 + 100/8 */
+    rtt_sample(&rtt, 100 * MS);
+    assert(rtt.rttvar == 50 * MS && rtt.srtt == 110937500);
+    assert(rtt.rto == 310937500 && rtt_timeout_ms(&rtt) == 311);
+}
+
+static void test_clamp(void) {
+    RttEstimator rtt;
+    int i;
+
+    /* 10 + 4 * 5 is below the minimum */
+    rtt_init(&rtt);
+    rtt_sample(&rtt, 10 * MS);
+    assert(rtt.srtt == 10 * MS && rtt.rto == RTO_MIN);
+
+    /* 2000 + 4 * 1000 is above the maximum */
+    rtt_init(&rtt);
+    rtt_sample(&rtt, 2000 * MS);
+    assert(rtt.rto == RTO_MAX);
+
+    /* a steady round trip decays rttvar until the timer granularity is
+       all that is left above srtt */
+    rtt_init(&rtt);
+    for (i = 0; i < 100; i++) {
+        rtt_sample(&rtt, 500 * MS);
+    }
+    assert(rtt.srtt == 500 * MS && 4 * rtt.rttvar < RTO_GRANULARITY);
+    assert(rtt.rto == 500 * MS + RTO_GRANULARITY);
+}
+
+static void test_backoff(void) {
+    const nstime_t rtos[] = {600 * MS, 1200 * MS, 2400 * MS, RTO_MAX, RTO_MAX};
+    RttEstimator rtt;
+    int i;
+
+    rtt_init(&rtt);
+    rtt_sample(&rtt, 100 * MS);
+
+    /* each timeout doubles the timeout up to the maximum */
+    for (i = 0; i < 5; i++) {
+        rtt_backoff(&rtt);
+        assert(rtt.rto == rtos[i] && rtt.backoff == (unsigned) i + 1);
+    }
+    assert(rtt.srtt == 100 * MS);
+
+    /* a new sample ends the backoff */
+    rtt_sample(&rtt, 100 * MS);
+    assert(rtt.backoff == 0 && rtt.rto == 250 * MS);
+}
+
+static void test_timing(void) {
+    RttEstimator rtt;
+
+    rtt_init(&rtt);
+    mytime_update();
+
+    /* one packet is timed at a time */
+    rtt_start(&rtt, 5);
+    rtt_start(&rtt, 6);
+    assert(rtt.timed_seq == 5);
+
+    /* an ACK short of it takes no sample */
+    mytime_update();
+    assert(rtt_ack(&rtt, 4) == 0 && rtt.srtt == 0);
+
+    /* an ACK covering it does, and timing stops */
+    assert(rtt_ack(&rtt, 6) == 1);
+    assert(rtt.srtt > 0 && rtt.timed_seq == 0);
+    assert(rtt_ack(&rtt, 6) == 0);
+
+    /* a timeout stops timing: the packet will be sent again (Karn) */
+    rtt_start(&rtt, 7);
+    rtt_backoff(&rtt);
+    mytime_update();
+    assert(rtt_ack(&rtt, 7) == 0 && rtt.backoff == 1);
+}
+
+int main() {
+    test_first_sample();
+    test_update();
+    test_clamp();
+    test_backoff();
+    test_timing();
+
+    printf("rtt: all tests passed\n");
+    return 0;
+}
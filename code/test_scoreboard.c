@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "scoreboard.h"
+
+/*
+  Check in_flight and lost against the states of the packets, and that
+  nothing past the cumulative ACK is marked ACKed.
+*/
+static void check_counts(Scoreboard *sb) {
+    unsigned in_flight = 0, lost = 0;
+    uint32_t seq;
+
+    for (seq = 1; seq <= sb->high_sent; seq++) {
+        switch (sb->packets[seq - 1].state) {
+            case SB_IN_FLIGHT:
+                in_flight++;
+                break;
+            case SB_LOST:
+                lost++;
+                break;
+            case SB_ACKED:
+                assert(seq <= sb->acked);
+                break;
+            case SB_UNSENT:
+                assert(0);
+        }
+    }
+
+    assert(sb->in_flight == in_flight);
+    assert(sb->lost == lost);
+}
+
+static void send_new(Scoreboard *sb, uint32_t first, uint32_t last) {
+    uint32_t seq;
+
+    for (seq = first; seq <= last; seq++) {
+        scoreboard_sent(sb, seq);
+    }
+}
+
+/* a SACK bitmap for ack with the packets in seqs set, 0-terminated */
+static uint16_t build_sack(uint8_t *sack, uint32_t ack, const uint32_t *seqs) {
+    uint16_t len = 0;
+    uint32_t bit;
+
+    memset(sack, 0, SACK_MAX_LEN);
+
+    for (; *seqs != 0; seqs++) {
+        bit = *seqs - ack - 1;
+        sack[bit / 8] |= 1 << (bit % 8);
+        if (bit / 8 + 1 > len) {
+            len = bit / 8 + 1;
+        }
+    }
+
+    return len;
+}
+
+static unsigned ack(Scoreboard *sb, uint32_t ack, const uint32_t *seqs,
+                    nstime_t *rtt) {
+    uint8_t sack[SACK_MAX_LEN];
+    uint16_t len = build_sack(sack, ack, seqs);
+    unsigned delivered;
+
+    /* let time pass between sending and acknowledging */
+    mytime_update();
+    delivered = scoreboard_ack(sb, ack, sack, len, rtt);
+    check_counts(sb);
+    return delivered;
+}
+
+static void test_sack_delivery(void) {
+    Scoreboard *sb = scoreboard_alloc();
+    const uint32_t none[] = {0}, sack_4_5[] = {4, 5, 0}, sack_14[] = {14, 0};
+    nstime_t rtt;
+
+    assert(sb != NULL);
+    assert(sb->in_flight == 0 && sb->lost == 0 && sb->high_sent == 0);
+
+    send_new(sb, 1, 10);
+    assert(sb->high_sent == 10 && sb->in_flight == 10);
+    check_counts(sb);
+
+    /* 1 and 2 ACKed, 4 and 5 SACKed */
+    assert(ack(sb, 2, sack_4_5, &rtt) == 4);
+    assert(sb->acked == 2 && sb->in_flight == 6);
+    assert(sb->packets[3].state == SB_SACKED);
+    assert(sb->packets[4].state == SB_SACKED);
+    assert(sb->packets[2].state == SB_IN_FLIGHT);
+    assert(rtt > 0);
+
+    /* the same ACK again delivers nothing and takes no sample */
+    assert(ack(sb, 2, sack_4_5, &rtt) == 0);
+    assert(rtt == 0);
+
+    /* a cumulative ACK over SACKed packets does not count them twice */
+    assert(ack(sb, 5, none, &rtt) == 1);
+    assert(sb->acked == 5 && sb->in_flight == 5);
+    assert(sb->packets[3].state == SB_ACKED);
+
+    /* an ACK past what was sent is cut to high_sent, and its SACKs are not
+       decoded against the cut ACK number */
+    assert(ack(sb, 12, sack_14, &rtt) == 5);
+    assert(sb->acked == 10 && sb->in_flight == 0);
+
+    scoreboard_free(sb);
+}
+
+static void test_sack_past_high_sent(void) {
+    Scoreboard *sb = scoreboard_alloc();
+    const uint32_t sack_far[] = {14, 0};
+    nstime_t rtt;
+
+    send_new(sb, 1, 6);
+
+    /* every SACK bit of an ACK at high_sent is past it */
+    assert(ack(sb, 6, sack_far, &rtt) == 6);
+    assert(sb->acked == 6 && sb->in_flight == 0);
+
+    scoreboard_free(sb);
+}
+
+static void test_loss_detection(void) {
+    Scoreboard *sb = scoreboard_alloc();
+    const uint32_t sack_4_5[] = {4, 5, 0}, sack_4_6[] = {4, 5, 6, 0},
+        sack_9[] = {4, 5, 6, 7, 8, 9, 0}, sack_12[] = {4, 5, 6, 7, 8, 9, 10,
+        11, 12, 0}, sack_14[] = {4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 0};
+    nstime_t rtt;
+
+    send_new(sb, 1, 10);
+
+    /* two later packets delivered are not enough */
+    assert(ack(sb, 2, sack_4_5, &rtt) == 4);
+    assert(sb->lost == 0 && scoreboard_next_lost(sb) == 0);
+
+    /* the third makes 3 lost */
+    assert(ack(sb, 2, sack_4_6, &rtt) == 1);
+    assert(sb->lost == 1 && sb->packets[2].state == SB_LOST);
+    assert(scoreboard_next_lost(sb) == 3);
+    assert(sb->in_flight == 4);
+
+    /* resending it puts it back in flight, counted from the resend */
+    scoreboard_sent(sb, 3);
+    assert(sb->lost == 0 && sb->in_flight == 5 && sb->retransmits == 1);
+    assert(scoreboard_next_lost(sb) == 0);
+    check_counts(sb);
+    send_new(sb, 11, 12);
+
+    /* packets sent before the resend do not make it lost again */
+    assert(ack(sb, 2, sack_9, &rtt) == 3);
+    assert(sb->lost == 0 && sb->packets[2].state == SB_IN_FLIGHT);
+
+    /* neither do two sent after it */
+    assert(ack(sb, 2, sack_12, &rtt) == 3);
+    assert(sb->lost == 0);
+
+    /* a resent packet is never marked lost by duplicate ACKs */
+    assert(scoreboard_mark_lost(sb, 3) == 0);
+
+    /* three sent after it make the resend lost too */
+    send_new(sb, 13, 14);
+    assert(ack(sb, 2, sack_14, &rtt) == 2);
+    assert(sb->lost == 1 && scoreboard_next_lost(sb) == 3);
+    assert(sb->in_flight == 0);
+
+    /* the second resend, ACKed alone, gives no sample (Karn's rule) */
+    scoreboard_sent(sb, 3);
+    assert(sb->packets[2].retransmits == 2 && sb->retransmits == 2);
+    assert(ack(sb, 14, sack_14 + 11, &rtt) == 1); /* no SACKs */
+    assert(rtt == 0);
+    assert(sb->acked == 14 && sb->in_flight == 0 && sb->lost == 0);
+
+    scoreboard_free(sb);
+}
+
+static void test_mark_lost(void) {
+    Scoreboard *sb = scoreboard_alloc();
+
+    send_new(sb, 1, 4);
+
+    assert(scoreboard_mark_lost(sb, 0) == 0);
+    assert(scoreboard_mark_lost(sb, 5) == 0);
+    assert(scoreboard_mark_lost(sb, 2) == 1);
+    assert(scoreboard_mark_lost(sb, 2) == 0);
+    assert(sb->lost == 1 && sb->in_flight == 3);
+    assert(scoreboard_next_lost(sb) == 2);
+    check_counts(sb);
+
+    scoreboard_free(sb);
+}
+
+static void test_timeout(void) {
+    Scoreboard *sb = scoreboard_alloc();
+    const uint32_t sack_5[] = {5, 0}, none[] = {0};
+    nstime_t rtt;
+
+    send_new(sb, 1, 8);
+    assert(ack(sb, 2, sack_5, &rtt) == 3);
+
+    /* everything in flight is lost, SACKed packets are not */
+    scoreboard_timeout(sb);
+    check_counts(sb);
+    assert(sb->in_flight == 0 && sb->lost == 5);
+    assert(sb->packets[4].state == SB_SACKED);
+    assert(scoreboard_next_lost(sb) == 3);
+
+    /* the lost packets are resent in order */
+    scoreboard_sent(sb, scoreboard_next_lost(sb));
+    assert(scoreboard_next_lost(sb) == 4);
+    scoreboard_sent(sb, scoreboard_next_lost(sb));
+    assert(scoreboard_next_lost(sb) == 6);
+    assert(sb->in_flight == 2 && sb->lost == 3);
+    check_counts(sb);
+
+    /* an ACK of lost packets delivers them too */
+    assert(ack(sb, 8, none, &rtt) == 5);
+    assert(sb->in_flight == 0 && sb->lost == 0);
+    assert(scoreboard_next_lost(sb) == 0);
+
+    scoreboard_free(sb);
+}
+
+int main() {
+    test_sack_delivery();
+    test_sack_past_high_sent();
+    test_loss_detection();
+    test_mark_lost();
+    test_timeout();
+
+    printf("scoreboard: all tests passed\n");
+    return 0;
+}
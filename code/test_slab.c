@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <assert.h>
+#include <string.h>
+#include "slab.h"
+#include "chunk.h"
+
+#define MAX_OBJECTS 1200
+
+static void *objects[MAX_OBJECTS];
+
+/* the slab an object of a cache of normal pages lives in */
+static SlabPage *page_of(void *obj, size_t size) {
+    return (SlabPage *) ((uintptr_t) obj & ~(uintptr_t) (size - 1));
+}
+
+/* whether the kernel has huge pages reserved, -1 if it cannot be told */
+static int hugepages_reserved(void) {
+    FILE *f = fopen("/proc/sys/vm/nr_hugepages", "r");
+    int n = -1;
+
+    if (f != NULL) {
+        if (fscanf(f, "%d", &n) != 1) {
+            n = -1;
+        }
+        fclose(f);
+    }
+
+    return n < 0 ? -1 : n > 0;
+}
+
+static void test_free_list(void) {
+    SlabCache cache;
+    uint8_t *a, *b, *c;
+
+    slab_cache_init(&cache, "test", 20, 0);
+    assert(cache.obj_size == 32 && cache.slabs == 0);
+
+    a = slab_alloc(&cache);
+    b = slab_alloc(&cache);
+    c = slab_alloc(&cache);
+    assert(a != NULL && b == a + 32 && c == b + 32);
+    assert(cache.slabs == 1 && cache.in_use == 3);
+
+    /* a freed object is handed out again, zeroed */
+    memset(b, 0xab, 20);
+    slab_free(&cache, b);
+    assert(cache.in_use == 2 && cache.peak == 3);
+    assert(slab_alloc(&cache) == b);
+    assert(b[0] == 0 && b[19] == 0);
+
+    /* the last object freed is the first reused */
+    slab_free(&cache, a);
+    slab_free(&cache, c);
+    slab_free(&cache, NULL);
+    assert(cache.in_use == 1 && cache.pages->in_use == 1);
+    assert(slab_alloc(&cache) == c);
+    assert(slab_alloc(&cache) == a);
+    assert(slab_alloc(&cache) == c + 32);
+    assert(cache.slabs == 1 && cache.peak == 4);
+}
+
+static void test_growth(void) {
+    SlabCache cache;
+    SlabPage *first, *second;
+    unsigned per_slab, i;
+
+    slab_cache_init(&cache, "test", 100, 0);
+    objects[0] = slab_alloc(&cache);
+    first = cache.pages;
+    per_slab = first->capacity;
+    assert(per_slab * cache.obj_size <= SLAB_SIZE - sizeof(SlabPage));
+    assert(per_slab < MAX_OBJECTS - 1);
+
+    /* one more object than a slab holds maps a second slab */
+    for (i = 1; i <= per_slab; i++) {
+        assert((objects[i] = slab_alloc(&cache)) != NULL);
+    }
+    second = cache.pages;
+    assert(second != first && second->next == first);
+    assert(cache.slabs == 2 && cache.capacity == 2 * per_slab);
+    assert(first->in_use == per_slab && second->in_use == 1);
+    assert(page_of(objects[per_slab], SLAB_SIZE) == second);
+
+    /* every object lies inside its slab, after the header */
+    for (i = 0; i <= per_slab; i++) {
+        SlabPage *page = page_of(objects[i], SLAB_SIZE);
+
+        assert(page == (i < per_slab ? first : second));
+        assert((uint8_t *) objects[i] >= (uint8_t *) (page + 1));
+        assert((uint8_t *) objects[i] + cache.obj_size <=
+               (uint8_t *) page + SLAB_SIZE);
+    }
+
+    /* freeing is counted against the slab each object came from */
+    for (i = 0; i <= per_slab; i++) {
+        slab_free(&cache, objects[i]);
+    }
+    assert(first->in_use == 0 && second->in_use == 0);
+    assert(cache.in_use == 0 && cache.peak == per_slab + 1);
+
+    /* the freed objects are used before a third slab is mapped */
+    for (i = 0; i <= per_slab; i++) {
+        assert(slab_alloc(&cache) != NULL);
+    }
+    assert(cache.slabs == 2);
+}
+
+static void test_alignment(void) {
+    SlabCache cache;
+    uintptr_t addr;
+    unsigned i;
+
+    /* chunks are laid out in whole cache lines, and must start on one */
+    slab_cache_init(&cache, "chunk", sizeof(chunk), 0);
+    assert(cache.obj_size % CHUNK_CACHE_LINE == 0);
+
+    for (i = 0; i < MAX_OBJECTS; i++) {
+        assert((objects[i] = slab_alloc(&cache)) != NULL);
+        addr = (uintptr_t) objects[i];
+        assert(addr % CHUNK_CACHE_LINE == 0);
+    }
+    assert(cache.slabs > 1);
+
+    /* and reused chunks keep it */
+    slab_free(&cache, objects[7]);
+    assert(slab_alloc(&cache) == objects[7]);
+
+    /* an odd size is rounded up to keep every object 16-byte aligned */
+    slab_cache_init(&cache, "odd", 41, 0);
+    for (i = 0; i < 100; i++) {
+        assert((uintptr_t) slab_alloc(&cache) % 16 == 0);
+    }
+}
+
+static void test_hugepage_fallback(void) {
+    SlabCache cache;
+    SlabPage *page;
+    unsigned i, n = 1000;
+    int reserved = hugepages_reserved();
+
+    slab_cache_init(&cache, "huge", 64, 1);
+
+    for (i = 0; i < n; i++) {
+        assert((objects[i] = slab_alloc(&cache)) != NULL);
+        memset(objects[i], 0xff, 64);
+    }
+
+    /* with huge pages or without, the slab has the huge page size and
+       alignment, so objects still find their slab by masking */
+    page = cache.pages;
+    assert(cache.slabs == 1 && page->size == SLAB_HUGE_SIZE);
+    assert((uintptr_t) page % SLAB_HUGE_SIZE == 0);
+    assert(page_of(objects[n - 1], SLAB_HUGE_SIZE) == page);
+
+    /* no huge pages reserved: the allocation fell back to normal pages */
+    if (reserved == 0) {
+        assert(!page->huge);
+    }
+
+    for (i = 0; i < n; i++) {
+        slab_free(&cache, objects[i]);
+    }
+    assert(page->in_use == 0 && cache.in_use == 0);
+}
+
+int main() {
+    test_free_list();
+    test_growth();
+    test_alignment();
+    test_hugepage_fallback();
+
+    printf("slab: all tests passed\n");
+    return 0;
+}
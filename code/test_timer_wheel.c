@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include <assert.h>
+#include "timer_wheel.h"
+
+#define MAX_FIRES 16
+
+typedef struct {
+    Timer timer;
+    mytime_t fired[MAX_FIRES]; /* the time of each expiry */
+    unsigned fires;
+    mytime_t period; /* re-armed this much later by its handler if not 0 */
+    unsigned rearms; /* how many times it is still re-armed */
+} TestTimer;
+
+static mytime_t now; /* the time passed to the running timer_wheel_expire */
+static unsigned order; /* expiries so far, across every timer */
+
+static void record(Timer *timer, void *arg) {
+    TestTimer *t = arg;
+
+    assert(&(t->timer) == timer);
+    assert(timer->pprev == NULL);
+    assert(t->fires < MAX_FIRES);
+    t->fired[t->fires++] = now;
+    order++;
+
+    if (t->rearms > 0) {
+        t->rearms--;
+        timer_arm(timer, timer->expires + t->period);
+    }
+}
+
+static void arm(TestTimer *t, mytime_t expires) {
+    t->fires = 0;
+    t->period = 0;
+    t->rearms = 0;
+    timer_init(&(t->timer), record, t);
+    timer_arm(&(t->timer), expires);
+}
+
+/*
+  Run the wheel as the reactor does: sleep for as long as
+  timer_wheel_next_timeout allows, then expire, until no timer is armed.
+  Returns the number of wake-ups.
+*/
+static unsigned run(void) {
+    unsigned wakeups = 0;
+    int timeout;
+
+    while ((timeout = timer_wheel_next_timeout(now)) >= 0) {
+        now += timeout;
+        timer_wheel_expire(now);
+        wakeups++;
+    }
+
+    return wakeups;
+}
+
+static void test_cascade(void) {
+    /* one timer on each level, each deadline just past a slot boundary */
+    const mytime_t delays[] = {
+        5, TW_L0_SLOTS + 3, (1UL << (TW_L0_BITS + TW_LN_BITS)) + 7,
+        (1UL << (TW_L0_BITS + 2 * TW_LN_BITS)) + 11
+    };
+    TestTimer timers[4];
+    mytime_t start = 1000;
+    unsigned i;
+
+    now = start;
+    timer_wheel_init(now);
+    assert(timer_wheel_next_timeout(now) == -1);
+
+    for (i = 0; i < 4; i++) {
+        arm(&timers[i], start + delays[i]);
+    }
+
+    /* every timer cascades down to level 0 and expires on time, waking up
+       at most once per turn of level 0 on the way */
+    assert(run() <= delays[3] / TW_L0_SLOTS + 8);
+    for (i = 0; i < 4; i++) {
+        assert(timers[i].fires == 1);
+        assert(timers[i].fired[0] == start + delays[i]);
+    }
+
+    /* the same timers, the wheel moved over all of them at once */
+    start = now;
+    for (i = 0; i < 4; i++) {
+        arm(&timers[3 - i], start + delays[3 - i]);
+    }
+    order = 0;
+    now = start + delays[3];
+    timer_wheel_expire(now);
+    assert(order == 4);
+    assert(timer_wheel_next_timeout(now) == -1);
+
+    /* an overdue timer expires at the next millisecond the wheel reaches */
+    arm(&timers[0], now - 50);
+    assert(timer_wheel_next_timeout(now) == 1);
+    now++;
+    timer_wheel_expire(now);
+    assert(timers[0].fires == 1 && timers[0].fired[0] == now);
+}
+
+static void test_rearm_in_handler(void) {
+    TestTimer fast, slow;
+    mytime_t start;
+    unsigned i;
+
+    start = now;
+
+    /* re-armed from its own handler every millisecond, and every 300
+       milliseconds, across a level 1 slot */
+    arm(&fast, start + 1);
+    fast.period = 1;
+    fast.rearms = 3;
+    arm(&slow, start + 100);
+    slow.period = 300;
+    slow.rearms = 2;
+
+    /* the deadlines set by the handlers are met within the same call */
+    now = start + 1000;
+    timer_wheel_expire(now);
+
+    assert(fast.fires == 4 && slow.fires == 3);
+    assert(fast.timer.expires == start + 4);
+    assert(slow.timer.expires == start + 700);
+    assert(timer_wheel_next_timeout(now) == -1);
+
+    /* and met on time when the wheel is run the reactor's way */
+    start = now;
+    arm(&slow, start + 100);
+    slow.period = 300;
+    slow.rearms = 2;
+    run();
+    assert(slow.fires == 3);
+    for (i = 0; i < 3; i++) {
+        assert(slow.fired[i] == start + 100 + i * 300);
+    }
+}
+
+static void test_cancel(void) {
+    TestTimer a, b;
+
+    /* cancelling an expired timer does nothing, and does not count it out
+       a second time */
+    arm(&a, now + 10);
+    arm(&b, now + 20);
+    now += 10;
+    timer_wheel_expire(now);
+    assert(a.fires == 1 && b.fires == 0);
+
+    timer_cancel(&(a.timer));
+    timer_cancel(&(a.timer));
+    assert(timer_wheel_next_timeout(now) == 10);
+
+    /* cancelling an armed timer keeps it from expiring */
+    timer_cancel(&(b.timer));
+    assert(b.timer.pprev == NULL);
+    assert(timer_wheel_next_timeout(now) == -1);
+    now += 100;
+    timer_wheel_expire(now);
+    assert(b.fires == 0);
+
+    /* a cancelled timer can be armed again */
+    timer_arm(&(b.timer), now + 5);
+    run();
+    assert(b.fires == 1 && b.fired[0] == b.timer.expires);
+
+    /* re-arming an armed timer moves its deadline */
+    arm(&a, now + TW_L0_SLOTS * 2);
+    timer_arm(&(a.timer), now + 3);
+    run();
+    assert(a.fires == 1 && a.fired[0] == a.timer.expires);
+    assert(timer_wheel_next_timeout(now) == -1);
+}
+
+int main() {
+    test_cascade();
+    test_rearm_in_handler();
+    test_cancel();
+
+    printf("timer_wheel: all tests passed\n");
+    return 0;
+}
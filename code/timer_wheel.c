@@ -0,0 +1,182 @@
+/*
+  Hierarchical timer wheel with cascading levels
+*/
+
+#include <stddef.h>
+
+#include "timer_wheel.h"
+
+#define TW_L0_MASK (TW_L0_SLOTS - 1)
+#define TW_LN_MASK (TW_LN_SLOTS - 1)
+#define TW_MAX_DELAY ((1UL << (TW_L0_BITS + (TW_LEVELS - 1) * TW_LN_BITS)) - 1)
+
+/* the bit where the slot index of the given level starts, level >= 1 */
+#define TW_LEVEL_SHIFT(level) (TW_L0_BITS + ((level) - 1) * TW_LN_BITS)
+
+static Timer *level0[TW_L0_SLOTS];
+static Timer *levels[TW_LEVELS - 1][TW_LN_SLOTS];
+static mytime_t current; /* the next millisecond to be expired */
+static unsigned armed; /* number of armed timers */
+
+static void slot_insert(Timer **slot, Timer *timer) {
+    timer->next = *slot;
+    timer->pprev = slot;
+
+    if (*slot != NULL) {
+        (*slot)->pprev = &(timer->next);
+    }
+
+    *slot = timer;
+}
+
+static void slot_remove(Timer *timer) {
+    *(timer->pprev) = timer->next;
+
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+/*
+  Put the timer in the slot that covers its deadline, relative to current.
+*/
+static void wheel_insert(Timer *timer) {
+    mytime_t expires = timer->expires;
+    mytime_t delay;
+    int level;
+
+    /* overdue timers expire at the next millisecond the wheel reaches */
+    if (expires < current) {
+        expires = current;
+    }
+
+    delay = expires - current;
+
+    if (delay > TW_MAX_DELAY) {
+        delay = TW_MAX_DELAY;
+        expires = current + delay;
+    }
+
+    if (delay < TW_L0_SLOTS) {
+        slot_insert(&(level0[expires & TW_L0_MASK]), timer);
+        return;
+    }
+
+    for (level = 1; level < TW_LEVELS - 1; level++) {
+        if (delay < (1UL << TW_LEVEL_SHIFT(level + 1))) {
+            break;
+        }
+    }
+
+    slot_insert(&(levels[level - 1][(expires >> TW_LEVEL_SHIFT(level)) &
+                                    TW_LN_MASK]), timer);
+}
+
+/*
+  Move every timer of a slot of the given level into the levels below it.
+  Returns the index of the slot.
+*/
+static unsigned cascade(int level) {
+    unsigned index = (current >> TW_LEVEL_SHIFT(level)) & TW_LN_MASK;
+    Timer *timer = levels[level - 1][index];
+    Timer *next;
+
+    levels[level - 1][index] = NULL;
+
+    for (; timer != NULL; timer = next) {
+        next = timer->next;
+        timer->pprev = NULL;
+        wheel_insert(timer);
+    }
+
+    return index;
+}
+
+void timer_wheel_init(mytime_t now) {
+    current = now;
+}
+
+void timer_init(Timer *timer, timer_handler handler, void *arg) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->expires = 0;
+    timer->handler = handler;
+    timer->arg = arg;
+}
+
+void timer_arm(Timer *timer, mytime_t expires) {
+    if (timer->pprev != NULL) {
+        slot_remove(timer);
+    }
+    else {
+        armed++;
+    }
+
+    timer->expires = expires;
+    wheel_insert(timer);
+}
+
+void timer_cancel(Timer *timer) {
+    if (timer->pprev != NULL) {
+        slot_remove(timer);
+        armed--;
+    }
+}
+
+void timer_wheel_expire(mytime_t now) {
+    Timer *timer;
+    Timer **slot;
+    int level;
+
+    /* nothing to walk past */
+    if (armed == 0) {
+        if (now > current) {
+            current = now;
+        }
+        return;
+    }
+
+    while (current <= now) {
+        slot = &(level0[current & TW_L0_MASK]);
+
+        /* refill level 0 from the level above whenever it wraps around */
+        if ((current & TW_L0_MASK) == 0) {
+            for (level = 1; level < TW_LEVELS && cascade(level) == 0;
+                 level++);
+        }
+
+        while ((timer = *slot) != NULL) {
+            slot_remove(timer);
+            armed--;
+            timer->handler(timer, timer->arg);
+        }
+
+        current++;
+    }
+}
+
+int timer_wheel_next_timeout(mytime_t now) {
+    unsigned i;
+
+    if (armed == 0) {
+        return -1;
+    }
+
+    /* the earliest deadline in level 0, or the next cascade; a row that
+       has not been refilled yet can only be scanned after its cascade */
+    for (i = 0; (current & TW_L0_MASK) != 0 &&
+             i < TW_L0_SLOTS - (current & TW_L0_MASK); i++) {
+        if (level0[(current + i) & TW_L0_MASK] != NULL) {
+            break;
+        }
+    }
+
+    if (current + i <= now) {
+        return 0;
+    }
+
+    return (int) (current + i - now);
+}
@@ -0,0 +1,67 @@
+/*
+  A hierarchical timer wheel.  Level 0 has one slot per millisecond for the
+  next TW_L0_SLOTS milliseconds, and every further level covers TW_LN_SLOTS
+  slots of the whole level below it.  Timers are embedded in the structure
+  they belong to, so arming, re-arming and cancelling a timer is O(1), and
+  only the slots whose time has come are visited when time moves forward.
+*/
+
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "mytime.h"
+
+#define TW_L0_BITS 8
+#define TW_LN_BITS 6
+#define TW_L0_SLOTS (1 << TW_L0_BITS)
+#define TW_LN_SLOTS (1 << TW_LN_BITS)
+#define TW_LEVELS 4 /* 2^26 ms, about 18 hours, is the longest delay */
+
+typedef struct timer Timer;
+
+/*
+  Called once the timer has expired.  The timer is no longer armed, so the
+  handler may arm it again or free the structure containing it.
+*/
+typedef void (*timer_handler)(Timer *timer, void *arg);
+
+struct timer {
+    Timer *next, **pprev; /* links in the slot list; pprev is NULL unarmed */
+    mytime_t expires; /* in milliseconds, as returned by millitime */
+    timer_handler handler;
+    void *arg;
+};
+
+/*
+  Start the wheel at time now.  Must be called before any timer is armed.
+*/
+void timer_wheel_init(mytime_t now);
+
+/*
+  Set up an unarmed timer that calls handler with arg when it expires.
+*/
+void timer_init(Timer *timer, timer_handler handler, void *arg);
+
+/*
+  Arm the timer to expire at the given time, replacing any earlier deadline.
+*/
+void timer_arm(Timer *timer, mytime_t expires);
+
+/*
+  Disarm the timer if it is armed.
+*/
+void timer_cancel(Timer *timer);
+
+/*
+  Move the wheel forward to time now and call the handlers of every timer
+  that expired on the way.
+*/
+void timer_wheel_expire(mytime_t now);
+
+/*
+  Returns the number of milliseconds the caller may sleep before it has to
+  call timer_wheel_expire again, or -1 if no timer is armed.
+*/
+int timer_wheel_next_timeout(mytime_t now);
+
+#endif
@@ -9,19 +9,21 @@
 #include "congestion.h"
 #include "mytime.h"
 #include "log.h"
+#include "slab.h"
 
-#define RTT 200 /* milliseconds */
+static SlabCache transfer_cache;
+static int transfer_cache_ready;
 
-int transfer_has_timeout(Transfer *transfer) {
-    int timedout = (millitime(NULL) - transfer->timestamp) > TIMEOUT_THRESHOLD;
-
-    /* check if the transfer has time-outed, and log the info for time-outs */
-    if (timedout) {
-        LOG("Transfer to peer (%u) for chunk (%u) has timedout.\n",
-            transfer->peer->id, transfer->c->id);
-    }
+void transfer_touch(Transfer *transfer) {
+    nanotime(&(transfer->timestamp));
+    timer_arm(&(transfer->timer), millitime(NULL) +
+              rtt_timeout_ms(&(transfer->cctrl.rtt)));
+}
 
-    return timedout;
+void transfer_set_timeout(Transfer *transfer, timer_handler handler,
+                          void *arg) {
+    timer_init(&(transfer->timer), handler, arg);
+    transfer_touch(transfer);
 }
 
 int delete_transfer(void *ptr) {
@@ -33,56 +35,47 @@ int delete_transfer(void *ptr) {
 
     /* turns the peer available sign on, be ready for next data transfer */
     transfer->peer->available = 1;
-    free(transfer);
+    timer_cancel(&(transfer->timer));
+    scoreboard_free(transfer->cctrl.board);
+    slab_free(&transfer_cache, transfer);
     return EXIT_SUCCESS;
 }
 
 Transfer *create_transfer(bt_peer_t *peer, chunk *c) {
-    Transfer *transfer = calloc(1, sizeof(Transfer));
+    Transfer *transfer;
 
-    if (transfer == NULL) {
+    if (!transfer_cache_ready) {
+        slab_cache_init(&transfer_cache, "transfer", sizeof(Transfer),
+                        SLAB_HUGEPAGES);
+        transfer_cache_ready = 1;
+    }
+
+    if ((transfer = slab_alloc(&transfer_cache)) == NULL) {
         return NULL;
     }
 
     transfer->peer = peer;
     transfer->c = c;
-    transfer->timestamp = millitime(NULL);
+    transfer->timestamp = nanotime(NULL);
+    transfer->pending = 0;
+    timer_init(&(transfer->timer), NULL, NULL);
 
     /* congestion control variables */
     transfer->cctrl.wind_size = DEFAULT_WIND_SIZE;
     transfer->cctrl.last_received = 0;
     transfer->cctrl.begin = 0;
-    transfer->cctrl.index = 0;
+    transfer->cctrl.board = NULL;
     transfer->cctrl.dup_count = 0;
     transfer->cctrl.timeout_count = 0;
+    transfer->cctrl.new_acks = 0;
+    transfer->cctrl.recover = 0;
+    transfer->cctrl.inflation = 0;
     transfer->cctrl.ssthresh = DEFAULT_SS_THRESH;
     transfer->cctrl.congest_state = SS;
-    transfer->cctrl.rtt = RTT; /* a fixed RTT for CA window size calculation */
+    rtt_init(&(transfer->cctrl.rtt));
 
     /* the peer is no longer available for another new data transfer */
     peer->available = 0;
 
     return transfer;
 }
-
-int compare_transfer_by_chunk_hash(const void *transfer, const void *bin_hash) {
-    Transfer *t = (Transfer *) transfer;
-    uint8_t *h = (uint8_t *) bin_hash;
-
-    if (t == NULL || h == NULL) {
-        return 0;
-    }
-
-    return compare_chunk_by_bin_hash(t->c, h);
-}
-
-int compare_transfer_by_peer_id(const void *transfer, const void *peer) {
-    Transfer *t = (Transfer *) transfer;
-    bt_peer_t *p = (bt_peer_t *) peer;
-
-    if (t == NULL || p == NULL) {
-        return 0;
-    }
-
-    return t->peer->id == p->id;
-}
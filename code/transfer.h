@@ -9,12 +9,14 @@
 
 #include "bt_parse.h"
 #include "chunk.h"
-#include "linkedlist.h"
+#include "timer_wheel.h"
+#include "rtt.h"
+#include "scoreboard.h"
 
-#define TIMEOUT_THRESHOLD 3000 /* milliseconds */
+#define DEFAULT_RTT (200 * NSEC_PER_MSEC) /* until the RTT is measured */
 #define MAX_TO_COUNTS 5 /* max timeouts before assuming peer is dead */
 
-enum CongestType {SS, CA};
+enum CongestType {SS, CA, FR}; /* FR: fast recovery */
 
 typedef struct {
     enum CongestType congest_state;
@@ -26,13 +28,18 @@ typedef struct {
 
     /* windows size variables */
         begin, /* beginning of the sliding window = LAST_ACK received */
-        index, /* index into the sliding window = the LAST PACKET SENT; max is 7*/
-        wind_size, /* congestion control window size */
+        wind_size, /* congestion control window size: packets in flight */
         start_wind_size, /* records the window size when entering CA mode */
-        rtt, /* records the round trip time of packet send and receive */
-        ssthresh; /* slow start threshold */
+        ssthresh, /* slow start threshold */
+        new_acks, /* new ACKs in this receive batch; window grows once */
+        recover, /* highest packet sent when the last loss was detected */
+        inflation; /* packets added to the window in FR mode for duplicate
+                      ACKs that carried no SACKs */
 
-    mytime_t rtt_timer; /* time since entering CA mode */
+    Scoreboard *board; /* state of every packet; the sender's only */
+
+    RttEstimator rtt; /* round trip time and retransmission timeout */
+    nstime_t rtt_timer; /* time of entering CA mode */
 } CongestCtrl;
 
 /* A connection that maintains the state of one data transfer
@@ -42,24 +49,25 @@ typedef struct _transfer {
     chunk *c;
 
     CongestCtrl cctrl;
-    mytime_t timestamp, /* records the time spent of each data transfer */
-        rtt; /* records the round trip time for CA mode */
+    int pending; /* output owed at the end of the receive batch:
+                    an ACK on the client, DATA on the server */
+    nstime_t timestamp; /* time of the last activity on the transfer */
+    Timer timer; /* fires one retransmission timeout after the last
+                    activity */
+    unsigned table_index; /* position in its transfer table */
 } Transfer;
 
 /*
-  Check the timestamp field of the transfer and return 1 if it has timeout,
-  0 otherwise
+  Record activity on the transfer: update its timestamp and push its timeout
+  back to the current retransmission timeout from now.
 */
-int transfer_has_timeout(Transfer *transfer);
+void transfer_touch(Transfer *transfer);
 
 /*
-  Return 1 if the transfer's chunk has the same hash as has, 0 otherwise
+  Set the handler called with arg when the transfer times out, and arm it.
 */
-int compare_transfer_by_chunk_hash(const void *transfer, const void *hash);
-
-/*
-  Return 1 if the transfer's peer has the same id as peer does, 0 otherwise */
-int compare_transfer_by_peer_id(const void *transfer, const void *peer);
+void transfer_set_timeout(Transfer *transfer, timer_handler handler,
+                          void *arg);
 
 /*
   Create a new transfer struct and associate it with the peer and chunk passed
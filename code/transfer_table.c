@@ -0,0 +1,180 @@
+/*
+  Dense array of transfers with indexes by peer id and by chunk hash
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "transfer_table.h"
+#include "hash.h"
+#include "log.h"
+
+/* an index has twice as many slots as the array, so it is at most half
+   full and every probe sequence ends at an empty slot */
+#define INDEX_MASK(table) (2 * (table)->capacity - 1)
+
+enum index_key {BY_PEER, BY_CHUNK};
+
+static unsigned peer_slot(TransferTable *table, short id) {
+    return ((uint32_t) id * 0x9E3779B1u) & INDEX_MASK(table);
+}
+
+static unsigned chunk_slot(TransferTable *table, uint8_t *bin_hash) {
+    uint32_t bits;
+
+    /* SHA-1 output needs no further mixing */
+    memcpy(&bits, bin_hash, sizeof(bits));
+    return bits & INDEX_MASK(table);
+}
+
+static unsigned home_slot(TransferTable *table, enum index_key key,
+                          Transfer *transfer) {
+    return key == BY_PEER ? peer_slot(table, transfer->peer->id) :
+        chunk_slot(table, transfer->c->bin_hash);
+}
+
+static void index_insert(TransferTable *table, Transfer **index,
+                         enum index_key key, Transfer *transfer) {
+    unsigned i = home_slot(table, key, transfer);
+
+    while (index[i] != NULL) {
+        i = (i + 1) & INDEX_MASK(table);
+    }
+
+    index[i] = transfer;
+}
+
+/*
+  Remove the transfer from an index by shifting the rest of its cluster
+  back over the hole.
+*/
+static void index_remove(TransferTable *table, Transfer **index,
+                         enum index_key key, Transfer *transfer) {
+    unsigned mask = INDEX_MASK(table);
+    unsigned hole, i, home;
+
+    for (hole = home_slot(table, key, transfer); index[hole] != transfer;
+         hole = (hole + 1) & mask) {
+        if (index[hole] == NULL) {
+            return;
+        }
+    }
+
+    for (i = (hole + 1) & mask; index[i] != NULL; i = (i + 1) & mask) {
+        home = home_slot(table, key, index[i]);
+
+        /* the entry can move if its home is not in (hole, i] */
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            index[hole] = index[i];
+            hole = i;
+        }
+    }
+
+    index[hole] = NULL;
+}
+
+/*
+  Allocate the array and indexes for the given capacity and fill the indexes
+  from the current items.
+*/
+static int resize(TransferTable *table, unsigned capacity) {
+    Transfer **items, **by_peer, **by_chunk;
+    unsigned i;
+
+    items = realloc(table->items, capacity * sizeof(Transfer *));
+    by_peer = calloc(2 * capacity, sizeof(Transfer *));
+    by_chunk = calloc(2 * capacity, sizeof(Transfer *));
+
+    if (items != NULL) {
+        table->items = items;
+    }
+
+    if (items == NULL || by_peer == NULL || by_chunk == NULL) {
+        LOG_ERROR("Failed to grow transfer table to (%u) transfers.\n",
+                  capacity);
+        free(by_peer);
+        free(by_chunk);
+        return -1;
+    }
+
+    free(table->by_peer);
+    free(table->by_chunk);
+    table->by_peer = by_peer;
+    table->by_chunk = by_chunk;
+    table->capacity = capacity;
+
+    for (i = 0; i < table->count; i++) {
+        index_insert(table, table->by_peer, BY_PEER, table->items[i]);
+        index_insert(table, table->by_chunk, BY_CHUNK, table->items[i]);
+    }
+
+    return 0;
+}
+
+int transfer_table_init(TransferTable *table) {
+    memset(table, 0, sizeof(TransferTable));
+    return resize(table, TRANSFER_TABLE_MIN_CAPACITY);
+}
+
+int transfer_table_insert(TransferTable *table, Transfer *transfer) {
+    if (transfer_table_find_by_peer(table, transfer->peer) != NULL ||
+        transfer_table_find_by_chunk(table, transfer->c->bin_hash) != NULL) {
+        LOG("Transfer with peer (%u) or chunk (%u) exists.\n",
+            transfer->peer->id, transfer->c->id);
+        return -1;
+    }
+
+    if (table->count == table->capacity &&
+        resize(table, 2 * table->capacity) < 0) {
+        return -1;
+    }
+
+    transfer->table_index = table->count;
+    table->items[table->count++] = transfer;
+
+    index_insert(table, table->by_peer, BY_PEER, transfer);
+    index_insert(table, table->by_chunk, BY_CHUNK, transfer);
+    return 0;
+}
+
+void transfer_table_remove(TransferTable *table, Transfer *transfer) {
+    unsigned i = transfer->table_index;
+
+    if (i >= table->count || table->items[i] != transfer) {
+        return;
+    }
+
+    index_remove(table, table->by_peer, BY_PEER, transfer);
+    index_remove(table, table->by_chunk, BY_CHUNK, transfer);
+
+    /* the last transfer fills the gap to keep the array dense */
+    table->items[i] = table->items[--table->count];
+    table->items[i]->table_index = i;
+}
+
+Transfer *transfer_table_find_by_peer(TransferTable *table, bt_peer_t *peer) {
+    unsigned i = peer_slot(table, peer->id);
+
+    while (table->by_peer[i] != NULL) {
+        if (table->by_peer[i]->peer->id == peer->id) {
+            return table->by_peer[i];
+        }
+        i = (i + 1) & INDEX_MASK(table);
+    }
+
+    return NULL;
+}
+
+Transfer *transfer_table_find_by_chunk(TransferTable *table,
+                                       uint8_t *bin_hash) {
+    unsigned i = chunk_slot(table, bin_hash);
+
+    while (table->by_chunk[i] != NULL) {
+        if (compare_bin_hash(table->by_chunk[i]->c->bin_hash, bin_hash)) {
+            return table->by_chunk[i];
+        }
+        i = (i + 1) & INDEX_MASK(table);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,60 @@
+/*
+  A table of the transfers of one side of the peer.  The transfers are kept
+  in a dense array for iteration, and two open addressing indexes find a
+  transfer by the id of its peer or by the hash of its chunk.  A table holds
+  at most one transfer per peer and one per chunk.
+*/
+
+#ifndef TRANSFER_TABLE_H
+#define TRANSFER_TABLE_H
+
+#include <inttypes.h>
+
+#include "bt_parse.h"
+#include "transfer.h"
+
+#define TRANSFER_TABLE_MIN_CAPACITY 16 /* must be a power of two */
+
+typedef struct {
+    Transfer **items; /* the transfers, items[0 .. count - 1] */
+    unsigned count, capacity;
+
+    /* indexes of 2 * capacity slots each, NULL marks an empty slot */
+    Transfer **by_peer;
+    Transfer **by_chunk;
+} TransferTable;
+
+/*
+  Initialize an empty table.
+
+  Returns 0 if successful, -1 otherwise.
+*/
+int transfer_table_init(TransferTable *table);
+
+/*
+  Add the transfer to the table.
+
+  Returns 0 if successful, -1 if the table could not grow or already holds a
+  transfer with the same peer or chunk.
+*/
+int transfer_table_insert(TransferTable *table, Transfer *transfer);
+
+/*
+  Remove the transfer from the table.  The transfer is not freed.  The last
+  transfer of the array takes its place.
+*/
+void transfer_table_remove(TransferTable *table, Transfer *transfer);
+
+/*
+  Returns the transfer with the given peer, NULL if there is none.
+*/
+Transfer *transfer_table_find_by_peer(TransferTable *table, bt_peer_t *peer);
+
+/*
+  Returns the transfer of the chunk with the given binary hash, NULL if there
+  is none.
+*/
+Transfer *transfer_table_find_by_chunk(TransferTable *table,
+                                       uint8_t *bin_hash);
+
+#endif
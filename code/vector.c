@@ -0,0 +1,71 @@
+/*
+  Growable array of pointers with inline storage for small sizes
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "vector.h"
+#include "log.h"
+
+void vector_init(Vector *v) {
+    v->items = v->inline_items;
+    v->size = 0;
+    v->capacity = VECTOR_INLINE_SIZE;
+}
+
+int vector_push(Vector *v, void *item) {
+    void **items;
+
+    if (v->size == v->capacity) {
+        if (v->items == v->inline_items) {
+            items = malloc(2 * v->capacity * sizeof(void *));
+
+            if (items != NULL) {
+                memcpy(items, v->inline_items, v->size * sizeof(void *));
+            }
+        } else {
+            items = realloc(v->items, 2 * v->capacity * sizeof(void *));
+        }
+
+        if (items == NULL) {
+            LOG_ERROR("Failed to grow vector to (%u) items.\n",
+                      2 * v->capacity);
+            return -1;
+        }
+
+        v->items = items;
+        v->capacity *= 2;
+    }
+
+    v->items[v->size++] = item;
+    return 0;
+}
+
+int vector_index_of(Vector *v, void *item) {
+    unsigned i;
+
+    for (i = 0; i < v->size; i++) {
+        if (v->items[i] == item) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void vector_swap_remove(Vector *v, unsigned i) {
+    v->items[i] = v->items[--v->size];
+}
+
+void vector_clear(Vector *v) {
+    v->size = 0;
+}
+
+void vector_free(Vector *v) {
+    if (v->items != v->inline_items) {
+        free(v->items);
+    }
+
+    vector_init(v);
+}
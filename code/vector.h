@@ -0,0 +1,52 @@
+/*
+  A growable array of pointers.  Small vectors keep their items inline and
+  only go to the heap once they outgrow VECTOR_INLINE_SIZE items, so the
+  short per-chunk peer lists cost no allocation at all.  A vector must not
+  be copied or moved once it has been initialized.
+*/
+
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#define VECTOR_INLINE_SIZE 4
+
+typedef struct {
+    void **items; /* inline_items until the vector outgrows it */
+    unsigned size, capacity;
+    void *inline_items[VECTOR_INLINE_SIZE];
+} Vector;
+
+/*
+  Initialize an empty vector.
+*/
+void vector_init(Vector *v);
+
+/*
+  Append item to the vector.
+
+  Returns 0 if successful, -1 if the vector could not grow.
+*/
+int vector_push(Vector *v, void *item);
+
+/*
+  Returns the index of the first occurrence of item, -1 if it is not in the
+  vector.
+*/
+int vector_index_of(Vector *v, void *item);
+
+/*
+  Remove the item at index i by moving the last item into its place.
+*/
+void vector_swap_remove(Vector *v, unsigned i);
+
+/*
+  Remove every item, keeping the storage.
+*/
+void vector_clear(Vector *v);
+
+/*
+  Release the heap storage of the vector, leaving it empty.
+*/
+void vector_free(Vector *v);
+
+#endif